@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DISPLAYCOLOR_LUT_DATA_H_
+#define DISPLAYCOLOR_LUT_DATA_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace gs101 {
+
+namespace lut_data_detail {
+
+/* entries made of four uint16_t fields red, green, blue, reserved, like drm_color_lut */
+template <typename EntryT>
+constexpr bool isRgbx16Entry() {
+    return std::is_standard_layout<EntryT>::value && sizeof(EntryT) == 4 * sizeof(uint16_t) &&
+            offsetof(EntryT, red) == 0 && offsetof(EntryT, green) == sizeof(uint16_t) &&
+            offsetof(EntryT, blue) == 2 * sizeof(uint16_t) &&
+            offsetof(EntryT, reserved) == 3 * sizeof(uint16_t);
+}
+
+/* green and blue are cleared if kRedOnly, the reserved field is always cleared */
+template <bool kRedOnly, typename ChannelT, size_t N, typename EntryT>
+inline void storeEntries(const ChannelT *r, const ChannelT *g, const ChannelT *b,
+                         EntryT (&dst)[N]) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    if constexpr (std::is_same<ChannelT, uint16_t>::value && isRgbx16Entry<EntryT>()) {
+        const uint16x8_t zero = vdupq_n_u16(0);
+        for (; i + 8 <= N; i += 8) {
+            uint16x8x4_t v;
+            v.val[0] = vld1q_u16(r + i);
+            v.val[1] = kRedOnly ? zero : vld1q_u16(g + i);
+            v.val[2] = kRedOnly ? zero : vld1q_u16(b + i);
+            v.val[3] = zero;
+            vst4q_u16(reinterpret_cast<uint16_t *>(&dst[i]), v);
+        }
+    }
+#endif
+    for (; i < N; i++) {
+        dst[i].red = r[i];
+        dst[i].green = kRedOnly ? 0 : g[i];
+        dst[i].blue = kRedOnly ? 0 : b[i];
+        dst[i].reserved = 0;
+    }
+}
+
+}  // namespace lut_data_detail
+
+/**
+ * Write the separate r/g/b channel arrays of a displaycolor LUT config (e.g.
+ * IDqe RegammaLut) to an interleaved uapi LUT (e.g. drm_color_lut) in one pass.
+ * The LUT length is checked at compile time.
+ */
+template <typename ChannelT, size_t N, typename EntryT>
+inline void interleaveLut(const std::array<ChannelT, N> &r, const std::array<ChannelT, N> &g,
+                          const std::array<ChannelT, N> &b, EntryT (&dst)[N]) {
+    lut_data_detail::storeEntries<false>(r.data(), g.data(), b.data(), dst);
+}
+
+/**
+ * Write a single channel displaycolor LUT config (e.g. IDqe DegammaLut) to the
+ * red field of an interleaved uapi LUT, the other fields are cleared.
+ */
+template <typename ChannelT, size_t N, typename EntryT>
+inline void expandLut(const std::array<ChannelT, N> &red, EntryT (&dst)[N]) {
+    lut_data_detail::storeEntries<true>(red.data(), red.data(), red.data(), dst);
+}
+
+}  // namespace gs101
+
+#endif  // DISPLAYCOLOR_LUT_DATA_H_
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DISPLAYCOLOR_MATRIX_DATA_H_
+#define DISPLAYCOLOR_MATRIX_DATA_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+namespace gs101 {
+
+namespace matrix_data_detail {
+
+template <typename A>
+struct ArraySize : std::integral_constant<size_t, std::tuple_size<A>::value> {};
+template <typename T, size_t N>
+struct ArraySize<T[N]> : std::integral_constant<size_t, N> {};
+
+/* Fixed trip count so the copy is unrolled/vectorized, no per-element checks */
+template <size_t kCount, typename Src, typename Dst>
+inline void copyFields(const Src &src, Dst &dst) {
+    static_assert(ArraySize<Src>::value == kCount, "unexpected source size");
+    static_assert(ArraySize<Dst>::value == kCount, "unexpected destination size");
+    for (size_t i = 0; i < kCount; i++) {
+        dst[i] = src[i];
+    }
+}
+
+}  // namespace matrix_data_detail
+
+/**
+ * Copy the matrix_data of a displaycolor matrix config (IDqe GammaMatrix and
+ * LinearMatrix, IDpp Gm) to register sized coefficient and offset arrays.
+ *
+ * displaycolor already provides the matrices in the register fixed-point
+ * format, so the values are copied as is. The dimensions come from
+ * ConfigT::kDimensions and are checked against both sides at compile time,
+ * for kernel uapi C arrays as well as std::array.
+ */
+template <typename ConfigT, typename CoeffsT, typename OffsetsT>
+inline void convertMatrixData(const ConfigT &config, CoeffsT &coeffs, OffsetsT &offsets) {
+    constexpr size_t kDimensions = ConfigT::kDimensions;
+
+    matrix_data_detail::copyFields<kDimensions * kDimensions>(config.matrix_data.coeffs, coeffs);
+    matrix_data_detail::copyFields<kDimensions>(config.matrix_data.offsets, offsets);
+}
+
+}  // namespace gs101
+
+#endif  // DISPLAYCOLOR_MATRIX_DATA_H_
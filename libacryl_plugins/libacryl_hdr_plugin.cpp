@@ -19,6 +19,7 @@
 #include <array>
 
 #include <gs101/displaycolor/displaycolor_gs101.h>
+#include <gs101/displaycolor/matrix_data.h>
 #include <hardware/exynos/g2d_hdr_plugin.h>
 
 #define HDR_BASE 0x3000
@@ -143,6 +144,18 @@ public:
                 offset = set_and_get_next_offset(offset, item);
         }
 
+        template <typename configT>
+        void updateGm(const configT &config, uint32_t coef_offset, uint32_t off_offset) {
+            using Container = typename configT::Container;
+            constexpr std::size_t kDimensions = configT::kDimensions;
+            std::array<Container, kDimensions * kDimensions> coeffs;
+            std::array<Container, kDimensions> offsets;
+
+            gs101::convertMatrixData(config, coeffs, offsets);
+            updateSingle(coeffs, coef_offset);
+            updateSingle(offsets, off_offset);
+        }
+
         void updateTmCoef(const displaycolor::IDisplayColorGS101::IDpp::DtmData::ConfigType &config, uint32_t offset) {
             offset = set_and_get_next_offset(offset, config.coeff_r | (config.coeff_g << 10) | (config.coeff_b << 20));
             offset = set_and_get_next_offset(offset, config.rng_x_min | (config.rng_x_max << 16));
@@ -193,8 +206,7 @@ public:
                 }
 
                 if (layer->Gm().enable && layer->Gm().config != nullptr) {
-                    mCmdList.updateSingle(layer->Gm().config->matrix_data.coeffs, HDR_GM_COEF(i));
-                    mCmdList.updateSingle(layer->Gm().config->matrix_data.offsets, HDR_GM_OFF(i));
+                    mCmdList.updateGm(*layer->Gm().config, HDR_GM_COEF(i), HDR_GM_OFF(i));
                     modectl |= HDR_ENABLE_GM;
                 }
 
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <log/log.h>
+
+#include <cstring>
+#include <memory>
+
+/*
+ * Stub IDisplayColorGS101 for HWC benchmarks and scene replays.
+ *
+ * Every stage is enabled and its register data is generated from a hash of
+ * the scene inputs the stage depends on, so the same scenes always produce
+ * the same blobs. A stage is marked dirty only when its inputs change, like
+ * the real library does, which keeps the HWC blob caching paths exercised.
+ */
+
+namespace displaycolor {
+
+namespace {
+
+using IDpp = IDisplayColorGS101::IDpp;
+using IDqe = IDisplayColorGS101::IDqe;
+
+/* FNV-1a over the raw bytes of scene fields */
+class SceneHash {
+    public:
+        template <typename T>
+        SceneHash &add(const T &value) {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+            for (size_t i = 0; i < sizeof(T); i++) {
+                mHash ^= bytes[i];
+                mHash *= 0x100000001b3ULL;
+            }
+            return *this;
+        }
+        uint64_t value() const { return mHash; }
+
+    private:
+        uint64_t mHash = 0xcbf29ce484222325ULL;
+};
+
+/* xorshift64, register values only need to be repeatable */
+class Generator {
+    public:
+        explicit Generator(uint64_t seed) : mState(seed ? seed : 1) {}
+        uint32_t next(uint32_t bits) {
+            mState ^= mState << 13;
+            mState ^= mState >> 7;
+            mState ^= mState << 17;
+            return static_cast<uint32_t>(mState) & ((bits >= 32) ? ~0u : ((1u << bits) - 1));
+        }
+
+    private:
+        uint64_t mState;
+};
+
+/* monotonic ramp with a seed dependent perturbation */
+template <typename T, size_t N>
+void fillRamp(std::array<T, N> &values, uint32_t bits, Generator &gen) {
+    const uint64_t max = (bits >= 32) ? 0xffffffffULL : ((1ULL << bits) - 1);
+    for (size_t i = 0; i < N; i++) {
+        const uint64_t base = (N > 1) ? max * i / (N - 1) : max;
+        values[i] = static_cast<T>(base - (base ? gen.next(4) % (base + 1) : 0));
+    }
+}
+
+template <typename ConfigT>
+void fillMatrix(ConfigT &config, uint32_t unity, Generator &gen) {
+    constexpr size_t kDimensions = ConfigT::kDimensions;
+    auto &data = config.matrix_data;
+    for (size_t i = 0; i < kDimensions * kDimensions; i++)
+        data.coeffs[i] = (i % (kDimensions + 1) == 0) ? unity - gen.next(6) : gen.next(4);
+    for (auto &offset : data.offsets) offset = gen.next(3);
+}
+
+template <typename TfT>
+void fillTransferFunction(TfT &tf, uint32_t xBits, uint32_t yBits, Generator &gen) {
+    fillRamp(tf.posx, xBits, gen);
+    fillRamp(tf.posy, yBits, gen);
+}
+
+/* Owns the config of one stage and regenerates it when its seed changes */
+template <typename StageT>
+class Stage {
+    public:
+        using ConfigType = typename StageT::ConfigType;
+
+        Stage() { mStage.config = &mConfig; }
+
+        template <typename FillT>
+        void update(uint64_t seed, FillT fill) {
+            if (mStage.enable && seed == mSeed) return;
+            mConfig = ConfigType{};
+            Generator gen(seed);
+            fill(mConfig, gen);
+            mSeed = seed;
+            mStage.enable = true;
+            mStage.dirty = true;
+        }
+        const StageT &get() const { return mStage; }
+
+    private:
+        ConfigType mConfig{};
+        StageT mStage;
+        uint64_t mSeed = 0;
+};
+
+class StubDpp : public IDpp {
+    public:
+        void update(const LayerColorData &layer, const DisplayScene &scene) {
+            const uint64_t layerSeed = SceneHash()
+                                               .add(layer.dataspace)
+                                               .add(layer.matrix)
+                                               .add(layer.dim_ratio)
+                                               .add(scene.color_mode)
+                                               .add(scene.render_intent)
+                                               .value();
+            mEotf.update(layerSeed, [](auto &config, Generator &gen) {
+                fillTransferFunction(config.tf_data, 16, 32, gen);
+            });
+            mGm.update(layerSeed ^ 1, [](auto &config, Generator &gen) {
+                fillMatrix(config, 1u << 16, gen);
+            });
+            mOetf.update(layerSeed ^ 2, [](auto &config, Generator &gen) {
+                fillTransferFunction(config.tf_data, 32, 10, gen);
+            });
+
+            /* DTM is only provided for layers with HDR10+ metadata and follows it per frame */
+            if (layer.dynamic_metadata.is_valid) {
+                const auto &metadata = layer.dynamic_metadata;
+                const uint64_t dtmSeed = SceneHash()
+                                                 .add(layerSeed)
+                                                 .add(metadata.display_maximum_luminance)
+                                                 .add(metadata.maxscl)
+                                                 .add(metadata.tm_knee_x)
+                                                 .add(metadata.tm_knee_y)
+                                                 .value();
+                mDtm.update(dtmSeed, [](auto &config, Generator &gen) {
+                    fillTransferFunction(config.tf_data, 16, 32, gen);
+                    config.coeff_r = gen.next(10);
+                    config.coeff_g = gen.next(10);
+                    config.coeff_b = gen.next(10);
+                    config.rng_x_max = 0xffff;
+                    config.rng_y_max = 0xffff;
+                });
+            }
+        }
+
+        const EotfData &EotfLut() const override { return mEotf.get(); }
+        const GmData &Gm() const override { return mGm.get(); }
+        const DtmData &Dtm() const override { return mDtm.get(); }
+        const OetfData &OetfLut() const override { return mOetf.get(); }
+
+    private:
+        Stage<EotfData> mEotf;
+        Stage<GmData> mGm;
+        Stage<DtmData> mDtm;
+        Stage<OetfData> mOetf;
+};
+
+class StubDqe : public IDqe {
+    public:
+        void update(const DisplayScene &scene) {
+            const uint64_t sceneSeed = SceneHash()
+                                               .add(scene.color_mode)
+                                               .add(scene.render_intent)
+                                               .add(scene.matrix)
+                                               .add(scene.force_hdr)
+                                               .add(scene.bm)
+                                               .add(scene.hdr_layer_state)
+                                               .value();
+            const bool force10bpc = (scene.dpu_bit_depth == BitDepth::kTen);
+
+            mControl.update(force10bpc ? 2 : 1, [force10bpc](auto &config, Generator &) {
+                config.force_10bpc = force10bpc;
+            });
+            mGammaMatrix.update(sceneSeed, [](auto &config, Generator &gen) {
+                fillMatrix(config, 1u << 10, gen);
+            });
+            mLinearMatrix.update(sceneSeed ^ 1, [](auto &config, Generator &gen) {
+                fillMatrix(config, 1u << 10, gen);
+            });
+            mDegamma.update(sceneSeed ^ 2, [](auto &config, Generator &gen) {
+                fillRamp(config.values, 12, gen);
+            });
+            mCgc.update(sceneSeed ^ 3, [](auto &config, Generator &gen) {
+                fillRamp(config.r_values, 12, gen);
+                fillRamp(config.g_values, 12, gen);
+                fillRamp(config.b_values, 12, gen);
+            });
+        }
+
+        /* the regamma LUT follows the brightness, like panel gamma compensation */
+        void updatePresent(const DisplayScene &scene) {
+            const uint64_t presentSeed =
+                    SceneHash().add(scene.color_mode).add(scene.dbv).add(scene.lhbm_on).value();
+            mRegamma.update(presentSeed, [](auto &config, Generator &gen) {
+                fillRamp(config.r_values, 10, gen);
+                fillRamp(config.g_values, 10, gen);
+                fillRamp(config.b_values, 10, gen);
+            });
+        }
+
+        const DqeControlData &DqeControl() const override { return mControl.get(); }
+        const DqeMatrixData &GammaMatrix() const override { return mGammaMatrix.get(); }
+        const DegammaLutData &DegammaLut() const override { return mDegamma.get(); }
+        const DqeMatrixData &LinearMatrix() const override { return mLinearMatrix.get(); }
+        const CgcData &Cgc() const override { return mCgc.get(); }
+        const RegammaLutData &RegammaLut() const override { return mRegamma.get(); }
+
+    private:
+        Stage<DqeControlData> mControl;
+        Stage<DqeMatrixData> mGammaMatrix;
+        Stage<DqeMatrixData> mLinearMatrix;
+        Stage<DegammaLutData> mDegamma;
+        Stage<CgcData> mCgc;
+        Stage<RegammaLutData> mRegamma;
+};
+
+class StubPanel : public IPanel {
+    public:
+        void updatePresent(const DisplayScene &scene) { mDbv = scene.dbv; }
+        uint32_t GetAdjustedBrightnessLevel() const override { return mDbv; }
+
+    private:
+        uint32_t mDbv = 0;
+};
+
+class StubPipeline : public IDisplayColorGS101::IDisplayPipelineData {
+    public:
+        void update(const DisplayScene &scene) {
+            /* one DPP per LayerColorData, in the same order */
+            mDpps.resize(scene.layer_data.size());
+            for (size_t i = 0; i < mDpps.size(); i++) {
+                if (mDpps[i] == nullptr) mDpps[i] = std::make_unique<StubDpp>();
+                mDpps[i]->update(scene.layer_data[i], scene);
+            }
+            mDqe.update(scene);
+        }
+        void updatePresent(const DisplayScene &scene) {
+            mDqe.updatePresent(scene);
+            mPanel.updatePresent(scene);
+        }
+
+        std::vector<std::reference_wrapper<const IDpp>> Dpp() const override {
+            std::vector<std::reference_wrapper<const IDpp>> dpps;
+            dpps.reserve(mDpps.size());
+            for (const auto &dpp : mDpps) dpps.emplace_back(*dpp);
+            return dpps;
+        }
+        const IDqe &Dqe() const override { return mDqe; }
+        const IPanel &Panel() const override { return mPanel; }
+
+    private:
+        std::vector<std::unique_ptr<StubDpp>> mDpps;
+        StubDqe mDqe;
+        StubPanel mPanel;
+};
+
+class DisplayColorStub : public IDisplayColorGS101 {
+    public:
+        explicit DisplayColorStub(const std::vector<DisplayInfo> &displayInfo)
+              : mDisplayCount(displayInfo.size()) {
+            mColorModes[hwc::ColorMode::NATIVE] = {hwc::RenderIntent::COLORIMETRIC};
+            mColorModes[hwc::ColorMode::SRGB] = {hwc::RenderIntent::COLORIMETRIC,
+                                                 hwc::RenderIntent::ENHANCE};
+            mColorModes[hwc::ColorMode::DISPLAY_P3] = {hwc::RenderIntent::COLORIMETRIC,
+                                                       hwc::RenderIntent::ENHANCE};
+        }
+
+        int Update(DisplayType display, const DisplayScene &scene) override {
+            if (!isValid(display)) return -EINVAL;
+            mPipelines[display].update(scene);
+            return 0;
+        }
+
+        int UpdatePresent(DisplayType display, const DisplayScene &scene) override {
+            if (!isValid(display)) return -EINVAL;
+            mPipelines[display].updatePresent(scene);
+            return 0;
+        }
+
+        bool IsRrCompensationEnabled(DisplayType) override { return false; }
+
+        const ColorModesMap &ColorModesAndRenderIntents(DisplayType) const override {
+            return mColorModes;
+        }
+
+        CalibrationInfo GetCalibrationInfo(DisplayType) const override { return {}; }
+
+        /* no blending preference, HWC keeps its defaults */
+        int GetBlendingProperty(DisplayType, hwc::PixelFormat &, hwc::Dataspace &,
+                                bool &) const override {
+            return -EOPNOTSUPP;
+        }
+
+        const IDisplayPipelineData *GetPipelineData(DisplayType display) const override {
+            return isValid(display) ? &mPipelines[display] : nullptr;
+        }
+
+    private:
+        bool isValid(DisplayType display) const {
+            return display >= 0 && static_cast<size_t>(display) < mDisplayCount &&
+                    display < DISPLAY_MAX;
+        }
+
+        const size_t mDisplayCount;
+        ColorModesMap mColorModes;
+        StubPipeline mPipelines[DISPLAY_MAX];
+};
+
+}  // namespace
+
+extern "C" {
+
+IDisplayColorGS101 *GetDisplayColorGS101(const std::vector<DisplayInfo> &display_info) {
+    static DisplayColorStub stub(display_info);
+    ALOGI("displaycolor stub for %zu display(s)", display_info.size());
+    return &stub;
+}
+
+const DisplayColorIntfVer *GetInterfaceVersion() {
+    return &kInterfaceVersion;
+}
+
+}  // extern "C"
+
+}  // namespace displaycolor
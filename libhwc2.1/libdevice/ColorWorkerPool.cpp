@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorWorkerPool.h"
+
+#include <pthread.h>
+
+using namespace gs101;
+
+ColorWorkerPool::ColorWorkerPool(uint32_t threads) {
+    for (uint32_t i = 0; i < threads; i++) {
+        mThreads.emplace_back([this]() { workerLoop(); });
+        pthread_setname_np(mThreads.back().native_handle(), "HWC-color");
+    }
+}
+
+ColorWorkerPool::~ColorWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mCondition.notify_all();
+    for (auto &thread : mThreads) thread.join();
+}
+
+std::future<int32_t> ColorWorkerPool::post(std::function<int32_t()> work) {
+    std::packaged_task<int32_t()> task(std::move(work));
+    std::future<int32_t> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(std::move(task));
+    }
+    mCondition.notify_one();
+    return result;
+}
+
+void ColorWorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this] { return mExit || !mQueue.empty(); });
+        /* pending work is still run so no poster waits on a broken promise */
+        if (mQueue.empty()) break;
+
+        std::packaged_task<int32_t()> task = std::move(mQueue.front());
+        mQueue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
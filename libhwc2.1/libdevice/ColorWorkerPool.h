@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COLOR_WORKER_POOL_H
+#define COLOR_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gs101 {
+
+/*
+ * Small fixed pool of threads running color preparation work of the
+ * built-in displays, so the work of one display can overlap with the
+ * composition of another. Work items are run in FIFO order.
+ */
+class ColorWorkerPool {
+    public:
+        explicit ColorWorkerPool(uint32_t threads);
+        ~ColorWorkerPool();
+
+        std::future<int32_t> post(std::function<int32_t()> work);
+
+    private:
+        void workerLoop();
+
+        std::vector<std::thread> mThreads;
+        std::mutex mMutex;
+        std::condition_variable mCondition;
+        std::deque<std::packaged_task<int32_t()>> mQueue;
+        bool mExit = false;
+};
+
+}  // namespace gs101
+
+#endif // COLOR_WORKER_POOL_H
@@ -16,13 +16,16 @@
 
 #include "ExynosDeviceModule.h"
 
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+
 #include "ExynosDisplayDrmInterfaceModule.h"
 
 extern struct exynos_hwc_control exynosHWCControl;
 
 using namespace gs101;
 
-ExynosDeviceModule::ExynosDeviceModule() : ExynosDevice(), mDisplayColorLoader(DISPLAY_COLOR_LIB) {
+ExynosDeviceModule::ExynosDeviceModule() : ExynosDevice() {
     exynosHWCControl.skipStaticLayers = false;
 
     std::vector<displaycolor::DisplayInfo> display_info;
@@ -35,18 +38,79 @@ ExynosDeviceModule::ExynosDeviceModule() : ExynosDevice(), mDisplayColorLoader(D
             moduleDisplayInterface->getDisplayInfo(display_info);
         }
     }
-    initDisplayColor(display_info);
+
+    if (property_get_bool(kColorAsyncPrepareProp, false))
+        mColorWorkerPool = std::make_unique<ColorWorkerPool>(kColorWorkerThreads);
+
+    if (property_get_bool(kDisplayColorAsyncLoadProp, false)) {
+        mDisplayColorLoadInfo = std::move(display_info);
+        mDisplayColorAsyncLoad = true;
+    } else {
+        initDisplayColor(display_info);
+    }
+}
+
+void ExynosDeviceModule::startDisplayColorLoad() {
+    if (!mDisplayColorAsyncLoad) return;
+
+    std::call_once(mDisplayColorLoadOnce, [this]() {
+        /*
+         * Displays start with the pass-through color path and switch to
+         * displaycolor on the first frame after it is ready.
+         */
+        mDisplayColorLoadThread = std::thread([this]() {
+            initDisplayColor(mDisplayColorLoadInfo);
+            onRefresh();
+        });
+    });
 }
 
 ExynosDeviceModule::~ExynosDeviceModule() {
+    if (mDisplayColorLoadThread.joinable()) mDisplayColorLoadThread.join();
 }
 
 int ExynosDeviceModule::initDisplayColor(
         const std::vector<displaycolor::DisplayInfo>& display_info) {
-    mDisplayColorInterface = mDisplayColorLoader.GetDisplayColorGS101(display_info);
-    if (mDisplayColorInterface == nullptr) {
+    /* an unset or empty property falls back to the built-in library name */
+    char libName[PROPERTY_VALUE_MAX];
+    property_get(kDisplayColorLibProp, libName, DISPLAY_COLOR_LIB);
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    auto loader = std::make_unique<DisplayColorLoader>(libName);
+    nsecs_t loaded = systemTime(SYSTEM_TIME_MONOTONIC);
+    IDisplayColorGS101* displayColorInterface = loader->GetDisplayColorGS101(display_info);
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    if (displayColorInterface == nullptr) {
         ALOGW("%s failed to load displaycolor", __func__);
     }
 
+    {
+        std::lock_guard<std::mutex> lock(mDisplayColorMutex);
+        mDisplayColorLoader = std::move(loader);
+        mDisplayColorLoadTime = end - start;
+        mDisplayColorVersion.store(mDisplayColorLoader->GetInterfaceVersion(),
+                                   std::memory_order_release);
+        mDisplayColorInterface.store(displayColorInterface, std::memory_order_release);
+        mDisplayColorLoaded.store(true, std::memory_order_release);
+    }
+
+    ALOGI("%s: %s took %" PRId64 " us (dlopen %" PRId64 " us, init %" PRId64 " us)", __func__,
+          libName, ns2us(end - start), ns2us(loaded - start), ns2us(end - loaded));
+
     return NO_ERROR;
 }
+
+ColorWorkerPool* ExynosDeviceModule::getDisplayColorWorkerPool() {
+    if (mColorWorkerPool == nullptr) return nullptr;
+
+    /* with a single built-in display on, there is no other composition to overlap */
+    uint32_t builtInOn = 0;
+    for (uint32_t i = 0; i < mDisplays.size(); i++) {
+        ExynosDisplay* display = mDisplays[i];
+        if (display->mType != HWC_DISPLAY_PRIMARY) continue;
+        if (display->mPowerModeState != HWC2_POWER_MODE_ON) return nullptr;
+        builtInOn++;
+    }
+    return (builtInOn > 1) ? mColorWorkerPool.get() : nullptr;
+}
@@ -19,11 +19,26 @@
 
 #include <gs101/displaycolor/displaycolor_gs101.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ColorWorkerPool.h"
 #include "DisplayColorLoader.h"
 #include "ExynosDevice.h"
 
 using namespace displaycolor;
 
+/* load libdisplaycolor on a background thread instead of in the constructor */
+constexpr char kDisplayColorAsyncLoadProp[] = "vendor.display.displaycolor.async_load";
+/* run displaycolor Update() and prepare color blobs on the color worker pool */
+constexpr char kColorAsyncPrepareProp[] = "vendor.display.color.async_prepare";
+/* one worker per built-in display */
+constexpr uint32_t kColorWorkerThreads = 2;
+/* alternative displaycolor library to load, e.g. libdisplaycolor_stub.so */
+constexpr char kDisplayColorLibProp[] = "vendor.display.displaycolor.lib";
+
 namespace gs101 {
 
 class ExynosDeviceModule : public ExynosDevice {
@@ -31,16 +46,54 @@ class ExynosDeviceModule : public ExynosDevice {
         ExynosDeviceModule();
         virtual ~ExynosDeviceModule();
 
-        IDisplayColorGS101* getDisplayColorInterface() { return mDisplayColorInterface; }
+        /*
+         * Non-blocking. Returns nullptr while displaycolor is still being loaded.
+         * The first call starts the asynchronous load.
+         */
+        IDisplayColorGS101* getDisplayColorInterface() {
+            startDisplayColorLoad();
+            return mDisplayColorInterface.load(std::memory_order_acquire);
+        }
+        /* displaycolor is loaded asynchronously and has not finished yet */
+        bool isDisplayColorLoading() const {
+            return mDisplayColorAsyncLoad && !mDisplayColorLoaded.load(std::memory_order_acquire);
+        }
+        const DisplayColorIntfVer* getDisplayColorVersion() const {
+            return mDisplayColorVersion.load(std::memory_order_acquire);
+        }
+        nsecs_t getDisplayColorLoadTime() const { return mDisplayColorLoadTime; }
         void setActiveDisplay(uint32_t index) { mActiveDisplay = index; }
         uint32_t getActiveDisplay() const { return mActiveDisplay; }
+        /* nullptr when color preparation runs on the composition thread */
+        ColorWorkerPool* getColorWorkerPool() { return mColorWorkerPool.get(); }
+        /*
+         * The pool for display color work that is handed over from one frame
+         * stage to a later one, so it overlaps the composition of the other
+         * built-in display. nullptr unless every built-in display is on.
+         */
+        ColorWorkerPool* getDisplayColorWorkerPool();
 
     private:
         int initDisplayColor(const std::vector<displaycolor::DisplayInfo>& display_info);
+        void startDisplayColorLoad();
 
-        IDisplayColorGS101* mDisplayColorInterface;
-        DisplayColorLoader mDisplayColorLoader;
+        std::atomic<IDisplayColorGS101*> mDisplayColorInterface = nullptr;
+        std::atomic<const DisplayColorIntfVer*> mDisplayColorVersion = &kInterfaceVersion;
+        std::unique_ptr<DisplayColorLoader> mDisplayColorLoader;
+        /*
+         * The load thread calls back into the device, so it is started by the
+         * first getDisplayColorInterface() after construction, not by the
+         * constructor.
+         */
+        bool mDisplayColorAsyncLoad = false;
+        std::vector<displaycolor::DisplayInfo> mDisplayColorLoadInfo;
+        std::once_flag mDisplayColorLoadOnce;
+        std::thread mDisplayColorLoadThread;
+        std::mutex mDisplayColorMutex;
+        std::atomic<bool> mDisplayColorLoaded = false;
+        nsecs_t mDisplayColorLoadTime = 0;
         uint32_t mActiveDisplay;
+        std::unique_ptr<ColorWorkerPool> mColorWorkerPool;
 };
 
 }  // namespace gs101
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DqeTableCache.h"
+
+#include <android-base/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Errors.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+using namespace android;
+using namespace gs101;
+
+static inline size_t alignEntrySize(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+DqeTableCache::~DqeTableCache() {
+    if (mWriterThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mWriterMutex);
+            mWriterExit = true;
+        }
+        mWriterCondition.notify_one();
+        /* a queued image is still written */
+        mWriterThread.join();
+    }
+    unmap();
+}
+
+uint64_t DqeTableCache::checksum(const void *data, size_t size, uint64_t seed) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+uint64_t DqeTableCache::makePanelKey(const std::string &panelSerial,
+                                     const displaycolor::DisplayColorIntfVer &version,
+                                     uint32_t calibration) {
+    const uint32_t fields[] = {version.major, version.minor, version.patch, calibration};
+    uint64_t hash = checksum(panelSerial.data(), panelSerial.size());
+    return checksum(fields, sizeof(fields), hash);
+}
+
+uint64_t DqeTableCache::makeKey(uint64_t panelKey, uint64_t sceneHash) {
+    return checksum(&sceneHash, sizeof(sceneHash), panelKey);
+}
+
+uint64_t DqeTableCache::entryChecksum(uint64_t key, uint32_t stage, const void *data,
+                                      uint32_t size) {
+    uint64_t hash = checksum(&key, sizeof(key));
+    hash = checksum(&stage, sizeof(stage), hash);
+    return checksum(data, size, hash);
+}
+
+void DqeTableCache::unmap() {
+    if (mMapped != nullptr) {
+        munmap(mMapped, mMappedSize);
+        mMapped = nullptr;
+    }
+    mMappedSize = 0;
+    mEntries.clear();
+}
+
+void DqeTableCache::open() {
+    unmap();
+
+    int fd = ::open(mPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGI("%s: no dqe table cache (%s)", __func__, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (static_cast<size_t>(st.st_size) < sizeof(FileHeader))) {
+        ALOGW("%s: invalid dqe table cache size", __func__);
+        close(fd);
+        return;
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        ALOGE("%s: failed to map %s (%s)", __func__, mPath.c_str(), strerror(errno));
+        return;
+    }
+    mMapped = mapped;
+    mMappedSize = st.st_size;
+
+    const uint8_t *base = static_cast<const uint8_t *>(mMapped);
+    const FileHeader *fileHeader = reinterpret_cast<const FileHeader *>(base);
+    if ((fileHeader->magic != kMagic) || (fileHeader->version != kFileVersion)) {
+        ALOGW("%s: stale dqe table cache (magic 0x%x, version %u)", __func__,
+              fileHeader->magic, fileHeader->version);
+        unmap();
+        return;
+    }
+
+    size_t offset = sizeof(FileHeader);
+    for (uint32_t i = 0; i < fileHeader->entryCount; i++) {
+        if (offset + sizeof(EntryHeader) > mMappedSize) break;
+        const EntryHeader *entry = reinterpret_cast<const EntryHeader *>(base + offset);
+        offset += sizeof(EntryHeader);
+        if (offset + entry->size > mMappedSize) break;
+
+        mEntries[EntryId(entry->key, entry->stage)] =
+                MappedEntry{entry, base + offset, false, false};
+        offset += alignEntrySize(entry->size);
+    }
+
+    ALOGI("%s: %zu dqe table cache entries", __func__, mEntries.size());
+}
+
+const void *DqeTableCache::find(uint64_t key, uint32_t stage, uint32_t size) {
+    auto stored = mStored.find(EntryId(key, stage));
+    if (stored != mStored.end())
+        return (stored->second.size() == size) ? stored->second.data() : nullptr;
+
+    auto it = mEntries.find(EntryId(key, stage));
+    if (it == mEntries.end()) return nullptr;
+
+    MappedEntry &entry = it->second;
+    if (!entry.verified) {
+        entry.valid = (entry.header->size == size) &&
+                (entryChecksum(key, stage, entry.payload, entry.header->size) ==
+                 entry.header->checksum);
+        entry.verified = true;
+        if (!entry.valid) ALOGW("%s: corrupt entry (stage %u) ignored", __func__, stage);
+    }
+
+    return entry.valid ? entry.payload : nullptr;
+}
+
+bool DqeTableCache::hasKey(uint64_t key) const {
+    for (auto *entries : {&mPending, &mStored}) {
+        auto it = entries->lower_bound(EntryId(key, 0));
+        if ((it != entries->end()) && (it->first.first == key)) return true;
+    }
+    auto it = mEntries.lower_bound(EntryId(key, 0));
+    return (it != mEntries.end()) && (it->first.first == key);
+}
+
+void DqeTableCache::store(uint64_t key, uint32_t stage, const void *data, uint32_t size) {
+    const void *cached = find(key, stage, size);
+    if ((cached != nullptr) && (memcmp(cached, data, size) == 0)) return;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    mPending[EntryId(key, stage)].assign(bytes, bytes + size);
+    mRecentKeys.erase(std::remove(mRecentKeys.begin(), mRecentKeys.end(), key),
+                      mRecentKeys.end());
+    mRecentKeys.push_back(key);
+}
+
+std::vector<uint8_t> DqeTableCache::buildImage() {
+    /* most recently stored keys first, then the mapped ones */
+    std::set<uint64_t> keys;
+    for (auto it = mRecentKeys.rbegin(); (it != mRecentKeys.rend()) && (keys.size() < kMaxKeys);
+         ++it)
+        keys.insert(*it);
+    for (auto &it : mEntries) {
+        if (keys.size() >= kMaxKeys) break;
+        keys.insert(it.first.first);
+    }
+
+    /* pending entries replace stored and mapped entries of the same key and stage */
+    struct ImageEntry {
+        const uint8_t *payload;
+        uint32_t size;
+        uint64_t checksum;
+    };
+    std::map<EntryId, ImageEntry> entries;
+    for (auto &it : mEntries) {
+        if ((keys.count(it.first.first) == 0) ||
+            (find(it.first.first, it.first.second, it.second.header->size) == nullptr))
+            continue;
+        entries[it.first] = {it.second.payload, it.second.header->size,
+                             it.second.header->checksum};
+    }
+    for (auto *pending : {&mStored, &mPending}) {
+        for (auto &it : *pending) {
+            if (keys.count(it.first.first) == 0) continue;
+            const uint32_t size = static_cast<uint32_t>(it.second.size());
+            entries[it.first] = {it.second.data(), size,
+                                 entryChecksum(it.first.first, it.first.second,
+                                               it.second.data(), size)};
+        }
+    }
+
+    size_t fileSize = sizeof(FileHeader);
+    for (auto &it : entries) fileSize += sizeof(EntryHeader) + alignEntrySize(it.second.size);
+
+    std::vector<uint8_t> image(fileSize, 0);
+    FileHeader *fileHeader = reinterpret_cast<FileHeader *>(image.data());
+    fileHeader->magic = kMagic;
+    fileHeader->version = kFileVersion;
+    fileHeader->entryCount = entries.size();
+
+    size_t offset = sizeof(FileHeader);
+    for (auto &it : entries) {
+        EntryHeader *entry = reinterpret_cast<EntryHeader *>(image.data() + offset);
+        entry->key = it.first.first;
+        entry->stage = it.first.second;
+        entry->size = it.second.size;
+        entry->checksum = it.second.checksum;
+        offset += sizeof(EntryHeader);
+        memcpy(image.data() + offset, it.second.payload, entry->size);
+        offset += alignEntrySize(entry->size);
+    }
+    return image;
+}
+
+int32_t DqeTableCache::writeImage(const std::string &path, const std::vector<uint8_t> &image) {
+    const std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        ALOGE("%s: failed to create %s (%s)", __func__, tmpPath.c_str(), strerror(errno));
+        return -errno;
+    }
+
+    bool written = android::base::WriteFully(fd, image.data(), image.size()) && (fsync(fd) == 0);
+    close(fd);
+    if (!written || (rename(tmpPath.c_str(), path.c_str()) != 0)) {
+        ALOGE("%s: failed to write %s (%s)", __func__, path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return -EIO;
+    }
+    return NO_ERROR;
+}
+
+void DqeTableCache::writerLoop() {
+    std::unique_lock<std::mutex> lock(mWriterMutex);
+    while (true) {
+        mWriterCondition.wait(lock, [this] { return mWriterExit || mWriterPending; });
+        if (!mWriterPending) break;
+
+        std::vector<uint8_t> image = std::move(mWriterImage);
+        mWriterPending = false;
+        lock.unlock();
+        writeImage(mPath, image);
+        lock.lock();
+    }
+}
+
+void DqeTableCache::flush() {
+    if (mPending.empty()) return;
+
+    std::vector<uint8_t> image = buildImage();
+
+    /* the mapping stays valid, entries written from now on are served from mStored */
+    for (auto &it : mPending) mStored[it.first] = std::move(it.second);
+    mPending.clear();
+    while (mRecentKeys.size() > kMaxKeys) {
+        const uint64_t key = mRecentKeys.front();
+        mRecentKeys.erase(mRecentKeys.begin());
+        for (auto it = mStored.lower_bound(EntryId(key, 0));
+             (it != mStored.end()) && (it->first.first == key);)
+            it = mStored.erase(it);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mWriterMutex);
+        mWriterImage = std::move(image);
+        mWriterPending = true;
+    }
+    if (!mWriterThread.joinable()) {
+        mWriterThread = std::thread([this]() { writerLoop(); });
+        pthread_setname_np(mWriterThread.native_handle(), "HWC-dqecache");
+    }
+    mWriterCondition.notify_one();
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DQE_TABLE_CACHE_H
+#define DQE_TABLE_CACHE_H
+
+#include <gs101/displaycolor/displaycolor_gs101.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+constexpr char kDqeTableCachePath[] = "/data/vendor/display/dqe_table_cache.bin";
+
+namespace gs101 {
+
+/*
+ * Persistent cache of serialized DQE stage payloads (the exact bytes handed to
+ * CreatePropertyBlob), keyed by panel serial, displaycolor interface version,
+ * panel calibration and the boot scene hash of the DQE state. The cache file is
+ * memory-mapped read-only on open() so the first frame after boot or HWC restart
+ * can create blobs without serializing the tables from IDqe. Every entry carries a checksum; entries that fail
+ * validation are ignored.
+ *
+ * File layout:
+ *   FileHeader
+ *   { EntryHeader, payload, padding to 8 bytes } * FileHeader::entryCount
+ */
+class DqeTableCache {
+    public:
+        DqeTableCache(const char *path) : mPath(path) {}
+        ~DqeTableCache();
+
+        /* Key part fixed for a panel, computed once per panel */
+        static uint64_t makePanelKey(const std::string &panelSerial,
+                                     const displaycolor::DisplayColorIntfVer &version,
+                                     uint32_t calibration);
+        static uint64_t makeKey(uint64_t panelKey, uint64_t sceneHash);
+        static uint64_t checksum(const void *data, size_t size,
+                                 uint64_t seed = kFnvOffsetBasis);
+
+        /* Map the cache file read-only. Missing or invalid files leave the cache empty. */
+        void open();
+        /* Validated payload of (key, stage), or nullptr if absent, stale or corrupt */
+        const void *find(uint64_t key, uint32_t stage, uint32_t size);
+        bool hasKey(uint64_t key) const;
+        /*
+         * Queue a payload to be persisted by the next flush(). A payload equal to
+         * the valid entry of (key, stage) is not queued.
+         */
+        void store(uint64_t key, uint32_t stage, const void *data, uint32_t size);
+        bool hasPendingEntries() const { return !mPending.empty(); }
+        /*
+         * Rewrite the cache file with the entries of the kMaxKeys most recent keys.
+         * The file image is built by the caller, it is written by the writer thread.
+         */
+        void flush();
+
+    private:
+        static constexpr uint32_t kMagic = 0x45514344; // "DCQE"
+        static constexpr uint32_t kFileVersion = 3;
+        /* a key per scene, keep the file to a few full DQE table sets */
+        static constexpr size_t kMaxKeys = 16;
+        static constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+        static constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t entryCount;
+            uint32_t reserved;
+        };
+        struct EntryHeader {
+            uint64_t key;
+            uint32_t stage;
+            uint32_t size;
+            uint64_t checksum;
+        };
+        struct MappedEntry {
+            const EntryHeader *header;
+            const uint8_t *payload;
+            /* checksum is verified once on first lookup */
+            bool verified;
+            bool valid;
+        };
+        using EntryId = std::pair<uint64_t, uint32_t>;
+
+        static uint64_t entryChecksum(uint64_t key, uint32_t stage, const void *data,
+                                      uint32_t size);
+        static int32_t writeImage(const std::string &path, const std::vector<uint8_t> &image);
+        std::vector<uint8_t> buildImage();
+        void writerLoop();
+        void unmap();
+
+        const std::string mPath;
+        void *mMapped = nullptr;
+        size_t mMappedSize = 0;
+        std::map<EntryId, MappedEntry> mEntries;
+        std::map<EntryId, std::vector<uint8_t>> mPending;
+        /* entries handed to the writer thread, newer than the mapped ones */
+        std::map<EntryId, std::vector<uint8_t>> mStored;
+        /* keys of mPending and mStored, most recent last */
+        std::vector<uint64_t> mRecentKeys;
+
+        /*
+         * File writes (fsync, rename) are issued by mWriterThread, started on the
+         * first flush(). Only the latest image is kept if the writer falls behind.
+         */
+        std::thread mWriterThread;
+        std::mutex mWriterMutex;
+        std::condition_variable mWriterCondition;
+        std::vector<uint8_t> mWriterImage;
+        bool mWriterPending = false;
+        bool mWriterExit = false;
+};
+
+}  // namespace gs101
+
+#endif // DQE_TABLE_CACHE_H
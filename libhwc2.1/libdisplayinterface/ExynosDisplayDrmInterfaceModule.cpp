@@ -17,34 +17,28 @@
 #include "BrightnessController.h"
 #include "ExynosDisplayDrmInterfaceModule.h"
 #include "ExynosPrimaryDisplayModule.h"
+#include <algorithm>
 #include <drm/samsung_drm.h>
+#include <gs101/displaycolor/lut_data.h>
+#include <gs101/displaycolor/matrix_data.h>
 
 using BrightnessRange = BrightnessController::BrightnessRange;
 
-template <typename T, typename M>
-int32_t convertDqeMatrixDataToMatrix(T &colorMatrix, M &mat,
-                                     uint32_t dimension) {
-    if (colorMatrix.coeffs.size() != (dimension * dimension)) {
-        HWC_LOGE(nullptr, "Invalid coeff size(%zu)",
-                colorMatrix.coeffs.size());
-        return -EINVAL;
-    }
-    for (uint32_t i = 0; i < (dimension * dimension); i++) {
-        mat.coeffs[i] = colorMatrix.coeffs[i];
-    }
+using namespace gs101;
 
-    if (colorMatrix.offsets.size() != dimension) {
-        HWC_LOGE(nullptr, "Invalid offset size(%zu)",
-                colorMatrix.offsets.size());
-        return -EINVAL;
-    }
-    for (uint32_t i = 0; i < dimension; i++) {
-        mat.offsets[i] = colorMatrix.offsets[i];
-    }
-    return NO_ERROR;
-}
+namespace {
+/* Accumulates the time spent in a color setting function */
+class ScopedColorCommitTimer {
+    public:
+        ScopedColorCommitTimer(nsecs_t &total)
+              : mTotal(total), mStart(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+        ~ScopedColorCommitTimer() { mTotal += systemTime(SYSTEM_TIME_MONOTONIC) - mStart; }
 
-using namespace gs101;
+    private:
+        nsecs_t &mTotal;
+        const nsecs_t mStart;
+};
+}  // namespace
 
 /////////////////////////////////////////////////// ExynosDisplayDrmInterfaceModule //////////////////////////////////////////////////////////////////
 ExynosDisplayDrmInterfaceModule::ExynosDisplayDrmInterfaceModule(ExynosDisplay *exynosDisplay)
@@ -54,6 +48,12 @@ ExynosDisplayDrmInterfaceModule::ExynosDisplayDrmInterfaceModule(ExynosDisplay *
 
 ExynosDisplayDrmInterfaceModule::~ExynosDisplayDrmInterfaceModule()
 {
+    waitDisplayColorBlobs();
+    releasePreparedDqeBlobs();
+    releasePreparedDppBlobs();
+    /* release the plane blobs while mDppBlobRefs is still alive */
+    mOldDppBlobs.clear();
+    destroyOldBlobs(mDppBlobRefs.unreferenced);
 }
 
 void ExynosDisplayDrmInterfaceModule::parseBpcEnums(const DrmProperty& property)
@@ -80,13 +80,17 @@ int32_t ExynosDisplayDrmInterfaceModule::initDrmDevice(DrmDevice *drmDevice)
     if (isPrimary() == false)
         return ret;
 
-    mOldDqeBlobs.init(drmDevice);
+    mOldDqeBlobs.init(drmDevice, &mColorCommitStats);
 
     initOldDppBlobs(drmDevice);
     if (mDrmCrtc->force_bpc_property().id())
         parseBpcEnums(mDrmCrtc->force_bpc_property());
 
-    mOldHistoBlobs.init(drmDevice);
+    mOldHistoBlobs.init(drmDevice, &mColorCommitStats);
+
+    /* map the DQE table cache now, the first delivery should not wait for the file */
+    mDqeTableCache = std::make_unique<DqeTableCache>(kDqeTableCachePath);
+    mDqeTableCache->open();
 
     return ret;
 }
@@ -96,6 +100,7 @@ void ExynosDisplayDrmInterfaceModule::destroyOldBlobs(
 {
     for (auto &blob : oldBlobs) {
         mDrmDevice->DestroyPropertyBlob(blob);
+        mColorCommitStats.blobDestroyed(blob);
     }
     oldBlobs.clear();
 }
@@ -103,7 +108,7 @@ void ExynosDisplayDrmInterfaceModule::destroyOldBlobs(
 int32_t ExynosDisplayDrmInterfaceModule::createCgcBlobFromIDqe(
         const IDisplayColorGS101::IDqe &dqe, uint32_t &blobId)
 {
-    struct cgc_lut cgc;
+    using CgcConfig = IDisplayColorGS101::IDqe::CgcData::ConfigType;
     const IDisplayColorGS101::IDqe::CgcData &cgcData = dqe.Cgc();
 
     if (cgcData.config == nullptr) {
@@ -111,22 +116,18 @@ int32_t ExynosDisplayDrmInterfaceModule::createCgcBlobFromIDqe(
         return -EINVAL;
     }
 
-    if ((cgcData.config->r_values.size() != DRM_SAMSUNG_CGC_LUT_REG_CNT) ||
-        (cgcData.config->g_values.size() != DRM_SAMSUNG_CGC_LUT_REG_CNT) ||
-        (cgcData.config->b_values.size() != DRM_SAMSUNG_CGC_LUT_REG_CNT)) {
-        ALOGE("CGC data size is not same (r: %zu, g: %zu: b: %zu)",
-                cgcData.config->r_values.size(),
-                cgcData.config->g_values.size(),
-                cgcData.config->b_values.size());
-        return -EINVAL;
-    }
+    /* the config has the layout of struct cgc_lut, it is passed to the kernel as is */
+    static_assert(CgcConfig::kChannelLutLen == DRM_SAMSUNG_CGC_LUT_REG_CNT,
+                  "CGC data size is not same");
+    static_assert(sizeof(CgcConfig) == sizeof(struct cgc_lut) &&
+                          offsetof(CgcConfig, r_values) == offsetof(struct cgc_lut, r_values) &&
+                          offsetof(CgcConfig, g_values) == offsetof(struct cgc_lut, g_values) &&
+                          offsetof(CgcConfig, b_values) == offsetof(struct cgc_lut, b_values),
+                  "CGC config layout differs from struct cgc_lut");
+    static_assert(sizeof(CgcConfig::Container) == sizeof(cgc_lut{}.r_values[0]),
+                  "CGC value size differs from struct cgc_lut");
 
-    for (uint32_t i = 0; i < DRM_SAMSUNG_CGC_LUT_REG_CNT; i++) {
-        cgc.r_values[i] = cgcData.config->r_values[i];
-        cgc.g_values[i] = cgcData.config->g_values[i];
-        cgc.b_values[i] = cgcData.config->b_values[i];
-    }
-    int ret = mDrmDevice->CreatePropertyBlob(&cgc, sizeof(cgc_lut), &blobId);
+    int ret = createDqeBlob(DqeBlobs::CGC, cgcData.config, sizeof(cgc_lut), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create cgc blob %d", ret);
         return ret;
@@ -157,11 +158,9 @@ int32_t ExynosDisplayDrmInterfaceModule::createDegammaLutBlobFromIDqe(
         return -EINVAL;
     }
 
-    struct drm_color_lut color_lut[IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen];
-    for (uint32_t i = 0; i < lut_size; i++) {
-        color_lut[i].red = dqe.DegammaLut().config->values[i];
-    }
-    ret = mDrmDevice->CreatePropertyBlob(color_lut, sizeof(color_lut), &blobId);
+    auto &color_lut = mDqeLutStaging.degamma;
+    expandLut(dqe.DegammaLut().config->values, color_lut);
+    ret = createDqeBlob(DqeBlobs::DEGAMMA_LUT, color_lut, sizeof(color_lut), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create degamma lut blob %d", ret);
         return ret;
@@ -186,19 +185,16 @@ int32_t ExynosDisplayDrmInterfaceModule::createRegammaLutBlobFromIDqe(
                  __func__, ret);
          return ret;
     }
-    if (lut_size != IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen) {
+    if (lut_size != IDisplayColorGS101::IDqe::RegammaLutData::ConfigType::kChannelLutLen) {
         HWC_LOGE(mExynosDisplay, "%s: invalid lut size (%" PRId64 ")",
                 __func__, lut_size);
         return -EINVAL;
     }
 
-    struct drm_color_lut color_lut[IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen];
-    for (uint32_t i = 0; i < lut_size; i++) {
-        color_lut[i].red = dqe.RegammaLut().config->r_values[i];
-        color_lut[i].green = dqe.RegammaLut().config->g_values[i];
-        color_lut[i].blue = dqe.RegammaLut().config->b_values[i];
-    }
-    ret = mDrmDevice->CreatePropertyBlob(color_lut, sizeof(color_lut), &blobId);
+    auto &color_lut = mDqeLutStaging.regamma;
+    const auto &regamma = *dqe.RegammaLut().config;
+    interleaveLut(regamma.r_values, regamma.g_values, regamma.b_values, color_lut);
+    ret = createDqeBlob(DqeBlobs::REGAMMA_LUT, color_lut, sizeof(color_lut), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create gamma lut blob %d", ret);
         return ret;
@@ -211,13 +207,8 @@ int32_t ExynosDisplayDrmInterfaceModule::createGammaMatBlobFromIDqe(
 {
     int ret = 0;
     struct exynos_matrix gamma_matrix;
-    if ((ret = convertDqeMatrixDataToMatrix(
-                    dqe.GammaMatrix().config->matrix_data, gamma_matrix, DRM_SAMSUNG_MATRIX_DIMENS)) != NO_ERROR)
-    {
-        HWC_LOGE(mExynosDisplay, "Failed to convert gamma matrix");
-        return ret;
-    }
-    ret = mDrmDevice->CreatePropertyBlob(&gamma_matrix, sizeof(gamma_matrix), &blobId);
+    convertMatrixData(*dqe.GammaMatrix().config, gamma_matrix.coeffs, gamma_matrix.offsets);
+    ret = createDqeBlob(DqeBlobs::GAMMA_MAT, &gamma_matrix, sizeof(gamma_matrix), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create gamma matrix blob %d", ret);
         return ret;
@@ -231,13 +222,8 @@ int32_t ExynosDisplayDrmInterfaceModule::createLinearMatBlobFromIDqe(
 {
     int ret = 0;
     struct exynos_matrix linear_matrix;
-    if ((ret = convertDqeMatrixDataToMatrix(
-                    dqe.LinearMatrix().config->matrix_data, linear_matrix, DRM_SAMSUNG_MATRIX_DIMENS)) != NO_ERROR)
-    {
-        HWC_LOGE(mExynosDisplay, "Failed to convert linear matrix");
-        return ret;
-    }
-    ret = mDrmDevice->CreatePropertyBlob(&linear_matrix, sizeof(linear_matrix), &blobId);
+    convertMatrixData(*dqe.LinearMatrix().config, linear_matrix.coeffs, linear_matrix.offsets);
+    ret = createDqeBlob(DqeBlobs::LINEAR_MAT, &linear_matrix, sizeof(linear_matrix), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create linear matrix blob %d", ret);
         return ret;
@@ -256,8 +242,8 @@ int32_t ExynosDisplayDrmInterfaceModule::createDispDitherBlobFromIDqe(
         return ret;
     }
 
-    ret = mDrmDevice->CreatePropertyBlob((void*)&dqeControl.config->disp_dither_reg,
-            sizeof(dqeControl.config->disp_dither_reg), &blobId);
+    ret = createColorBlob(&dqeControl.config->disp_dither_reg,
+            sizeof(dqeControl.config->disp_dither_reg), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create disp dither blob %d", ret);
         return ret;
@@ -276,8 +262,8 @@ int32_t ExynosDisplayDrmInterfaceModule::createCgcDitherBlobFromIDqe(
         return ret;
     }
 
-    ret = mDrmDevice->CreatePropertyBlob((void*)&dqeControl.config->cgc_dither_reg,
-            sizeof(dqeControl.config->cgc_dither_reg), &blobId);
+    ret = createColorBlob(&dqeControl.config->cgc_dither_reg,
+            sizeof(dqeControl.config->cgc_dither_reg), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create disp dither blob %d", ret);
         return ret;
@@ -288,26 +274,26 @@ int32_t ExynosDisplayDrmInterfaceModule::createCgcDitherBlobFromIDqe(
 int32_t ExynosDisplayDrmInterfaceModule::createEotfBlobFromIDpp(
         const IDisplayColorGS101::IDpp &dpp, uint32_t &blobId)
 {
-    struct hdr_eotf_lut eotf_lut;
+    using EotfConfig = IDisplayColorGS101::IDpp::EotfData::ConfigType;
+    using EotfTfData = decltype(EotfConfig::tf_data);
 
     if (dpp.EotfLut().config == nullptr) {
         ALOGE("no dpp eotf config");
         return -EINVAL;
     }
 
-    if ((dpp.EotfLut().config->tf_data.posx.size() != DRM_SAMSUNG_HDR_EOTF_LUT_LEN) ||
-        (dpp.EotfLut().config->tf_data.posy.size() != DRM_SAMSUNG_HDR_EOTF_LUT_LEN)) {
-        HWC_LOGE(mExynosDisplay, "%s: eotf pos size (%zu, %zu)",
-                __func__, dpp.EotfLut().config->tf_data.posx.size(),
-                dpp.EotfLut().config->tf_data.posy.size());
-        return -EINVAL;
-    }
+    /* tf_data has the layout of struct hdr_eotf_lut, it is passed to the kernel as is */
+    static_assert(EotfConfig::kLutLen == DRM_SAMSUNG_HDR_EOTF_LUT_LEN, "eotf pos size");
+    static_assert(sizeof(EotfTfData) == sizeof(struct hdr_eotf_lut) &&
+                          offsetof(EotfTfData, posx) == offsetof(struct hdr_eotf_lut, posx) &&
+                          offsetof(EotfTfData, posy) == offsetof(struct hdr_eotf_lut, posy),
+                  "eotf config layout differs from struct hdr_eotf_lut");
+    static_assert(sizeof(EotfConfig::XContainer) == sizeof(hdr_eotf_lut{}.posx[0]) &&
+                          sizeof(EotfConfig::YContainer) == sizeof(hdr_eotf_lut{}.posy[0]),
+                  "eotf pos size differs from struct hdr_eotf_lut");
 
-    for (uint32_t i = 0; i < DRM_SAMSUNG_HDR_EOTF_LUT_LEN; i++) {
-        eotf_lut.posx[i] = dpp.EotfLut().config->tf_data.posx[i];
-        eotf_lut.posy[i] = dpp.EotfLut().config->tf_data.posy[i];
-    }
-    int ret = mDrmDevice->CreatePropertyBlob(&eotf_lut, sizeof(eotf_lut), &blobId);
+    int ret = createColorBlob(&dpp.EotfLut().config->tf_data, sizeof(struct hdr_eotf_lut),
+                              blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create eotf lut blob %d", ret);
         return ret;
@@ -326,13 +312,8 @@ int32_t ExynosDisplayDrmInterfaceModule::createGmBlobFromIDpp(
         return -EINVAL;
     }
 
-    if ((ret = convertDqeMatrixDataToMatrix(dpp.Gm().config->matrix_data, gm_matrix,
-                                            DRM_SAMSUNG_HDR_GM_DIMENS)) != NO_ERROR)
-    {
-        HWC_LOGE(mExynosDisplay, "Failed to convert gm matrix");
-        return ret;
-    }
-    ret = mDrmDevice->CreatePropertyBlob(&gm_matrix, sizeof(gm_matrix), &blobId);
+    convertMatrixData(*dpp.Gm().config, gm_matrix.coeffs, gm_matrix.offsets);
+    ret = createColorBlob(&gm_matrix, sizeof(gm_matrix), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create gm matrix blob %d", ret);
         return ret;
@@ -371,7 +352,7 @@ int32_t ExynosDisplayDrmInterfaceModule::createDtmBlobFromIDpp(
     tm_data.rng_y_min = dpp.Dtm().config->rng_y_min;
     tm_data.rng_y_max = dpp.Dtm().config->rng_y_max;
 
-    int ret = mDrmDevice->CreatePropertyBlob(&tm_data, sizeof(tm_data), &blobId);
+    int ret = createColorBlob(&tm_data, sizeof(tm_data), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create tm_data blob %d", ret);
         return ret;
@@ -401,7 +382,7 @@ int32_t ExynosDisplayDrmInterfaceModule::createOetfBlobFromIDpp(
         oetf_lut.posx[i] = dpp.OetfLut().config->tf_data.posx[i];
         oetf_lut.posy[i] = dpp.OetfLut().config->tf_data.posy[i];
     }
-    int ret = mDrmDevice->CreatePropertyBlob(&oetf_lut, sizeof(oetf_lut), &blobId);
+    int ret = createColorBlob(&oetf_lut, sizeof(oetf_lut), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create oetf lut blob %d", ret);
         return ret;
@@ -409,6 +390,29 @@ int32_t ExynosDisplayDrmInterfaceModule::createOetfBlobFromIDpp(
     return NO_ERROR;
 }
 
+int32_t ExynosDisplayDrmInterfaceModule::createDqeStageBlob(
+        const uint32_t type, const IDisplayColorGS101::IDqe &dqe, uint32_t &blobId)
+{
+    switch (type) {
+        case DqeBlobs::CGC:
+            return createCgcBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::DEGAMMA_LUT:
+            return createDegammaLutBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::REGAMMA_LUT:
+            return createRegammaLutBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::GAMMA_MAT:
+            return createGammaMatBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::LINEAR_MAT:
+            return createLinearMatBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::DISP_DITHER:
+            return createDispDitherBlobFromIDqe(dqe, blobId);
+        case DqeBlobs::CGC_DITHER:
+            return createCgcDitherBlobFromIDqe(dqe, blobId);
+        default:
+            return -EINVAL;
+    }
+}
+
 template<typename StageDataType>
 int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorBlob(
         const DrmProperty &prop,
@@ -420,58 +424,63 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorBlob(
     /* dirty bit is valid only if enable is true */
     if (!prop.id())
         return NO_ERROR;
-    if (!mForceDisplayColorSetting && stage.enable && !stage.dirty)
+    const bool repush = mDqeRepushMask & (1u << type);
+    if (!mForceDisplayColorSetting && !repush && stage.enable && !stage.dirty)
         return NO_ERROR;
 
     int32_t ret = 0;
     uint32_t blobId = 0;
+    bool cached = false;
+    bool prepared = false;
+    const uint32_t oldBlobId = mOldDqeBlobs.getBlob(type);
 
-    if (stage.enable) {
-        switch (type) {
-            case DqeBlobs::CGC:
-                ret = createCgcBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::DEGAMMA_LUT:
-                ret = createDegammaLutBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::REGAMMA_LUT:
-                ret = createRegammaLutBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::GAMMA_MAT:
-                ret = createGammaMatBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::LINEAR_MAT:
-                ret = createLinearMatBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::DISP_DITHER:
-                ret = createDispDitherBlobFromIDqe(dqe, blobId);
-                break;
-            case DqeBlobs::CGC_DITHER:
-                ret = createCgcDitherBlobFromIDqe(dqe, blobId);
-                break;
-            default:
-                ret = -EINVAL;
-        }
+    /*
+     * The checkpoint blob holds exactly this stage's data if the enable state
+     * matches, and so does the last blob of a repushed stage that is not dirty.
+     */
+    const bool restore = (mDqeCheckpointRestore || (repush && !(stage.enable && stage.dirty))) &&
+            (stage.enable == (oldBlobId != 0));
+    if (restore) {
+        blobId = oldBlobId;
+    } else if (stage.enable && (mPreparedDqeBlobs[type] != 0) && !mDqeTableCacheRecord) {
+        /* created from the same IDqe data by prepareDisplayColorBlobs() */
+        blobId = mPreparedDqeBlobs[type];
+        mPreparedDqeBlobs[type] = 0;
+        prepared = true;
+    } else if (stage.enable && mDqeTableCacheLookup) {
+        cached = createDqeBlobFromCache(type, blobId);
+        mDqeBlobFromCache |= cached;
+    }
+
+    if (stage.enable && !cached && !restore && !prepared) {
+        ret = createDqeStageBlob(type, dqe, blobId);
         if (ret != NO_ERROR) {
             HWC_LOGE(mExynosDisplay, "%s: create blob fail", __func__);
             return ret;
         }
     }
 
-    /* Skip setting when previous and current setting is same with 0 */
-    if ((blobId == 0) && (mOldDqeBlobs.getBlob(type) == 0))
+    /*
+     * Skip setting when previous and current setting is same with 0.
+     * Reclaimed blobs may still be set in the kernel, so 0 is not known there.
+     */
+    if ((blobId == 0) && (oldBlobId == 0) && !mOldDqeBlobs.isReclaimed())
         return ret;
 
-    if ((ret = drmReq.atomicAddProperty(mDrmCrtc->id(), prop, blobId)) < 0) {
+    if ((ret = addColorProperty(drmReq, mDrmCrtc->id(), prop, blobId)) < 0) {
         HWC_LOGE(mExynosDisplay, "%s: Fail to set property",
                 __func__);
         return ret;
     }
-    mOldDqeBlobs.addBlob(type, blobId);
+    if (!restore)
+        mOldDqeBlobs.addBlob(type, blobId);
+    mDqeDeliveredMask |= (1u << type);
 
     // disp_dither and cgc dither are part of DqeCtrl stage and the notification
     // will be sent after all data in DqeCtrl stage are applied.
-    if (type != DqeBlobs::DISP_DITHER && type != DqeBlobs::CGC_DITHER)
+    // Cached tables are not notified so that the stage stays dirty and the
+    // tables computed by displaycolor are delivered on the next frame.
+    if (type != DqeBlobs::DISP_DITHER && type != DqeBlobs::CGC_DITHER && !cached)
         stage.NotifyDataApplied();
 
     return ret;
@@ -481,8 +490,35 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorSetting(
 {
     if (isPrimary() == false)
         return NO_ERROR;
+
+    waitDisplayColorBlobs();
+    int32_t ret = setDisplayColorStages(drmReq);
+    /*
+     * Prepared blobs hold the IDqe data of this delivery only, displaycolor
+     * may update it before the next one.
+     */
+    releasePreparedDqeBlobs();
+
+    return ret;
+}
+
+int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorStages(
+        ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq)
+{
+
+    mColorCommitStats.frames++;
+    mDqeDeliveredMask = 0;
     if (!mForceDisplayColorSetting && !mColorSettingChanged)
         return NO_ERROR;
+    if (!mForceDisplayColorSetting && mColorUpdateSuspended) {
+        mColorCommitStats.suspendedFrames++;
+        return NO_ERROR;
+    }
+
+    if (mDqeRepushMask)
+        mColorCommitStats.repushes++;
+
+    ScopedColorCommitTimer timer(mColorCommitStats.time);
 
     ExynosPrimaryDisplayModule* display =
         (ExynosPrimaryDisplayModule*)mExynosDisplay;
@@ -490,6 +526,22 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorSetting(
     int ret = NO_ERROR;
     const IDisplayColorGS101::IDqe &dqe = display->getDqe();
 
+    updateDqeTableCacheKey();
+
+    mDqeCheckpointRestore = false;
+    if (mDqeCheckpointRestoreRequested && mForceDisplayColorSetting) {
+        mDqeCheckpointRestoreRequested = false;
+        if (mDqeCheckpointValid && (mDqeCheckpointHash == mDqeSceneHash)) {
+            mDqeCheckpointRestore = true;
+            mColorCommitStats.checkpointRestores++;
+        } else {
+            mColorCommitStats.checkpointMisses++;
+        }
+    }
+    /* mOldDqeBlobs is only a valid checkpoint once every stage below is delivered */
+    mDqeCheckpointValid = false;
+    mDqeBlobFromCache = false;
+
     if ((mDrmCrtc->cgc_lut_property().id() != 0) &&
         (ret = setDisplayColorBlob(mDrmCrtc->cgc_lut_property(),
                 static_cast<uint32_t>(DqeBlobs::CGC),
@@ -545,7 +597,7 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorSetting(
         if (ret < 0) {
             HWC_LOGE(mExynosDisplay, "Fail to convert bpc(%d)", bpc);
         } else {
-            if ((ret = drmReq.atomicAddProperty(mDrmCrtc->id(), prop_force_bpc,
+            if ((ret = addColorProperty(drmReq, mDrmCrtc->id(), prop_force_bpc,
                             bpcEnum, true)) < 0) {
                 HWC_LOGE(mExynosDisplay, "%s: Fail to set force bpc property",
                         __func__);
@@ -554,9 +606,194 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayColorSetting(
     }
     dqe.DqeControl().NotifyDataApplied();
 
+    /* cached tables may be stale and get replaced on the next frame */
+    mDqeCheckpointValid = !mDqeBlobFromCache;
+    mDqeCheckpointHash = mDqeSceneHash;
+    mDqeCheckpointRestore = false;
+    mDqeRepushMask = 0;
+    if (mForceDisplayColorSetting)
+        mOldDqeBlobs.clearReclaimed();
+
+    mDqeTableCacheLookup = false;
+    if (mDqeTableCacheRecord && mDqeTableCache->hasPendingEntries())
+        mDqeTableCache->flush();
+    mDqeTableCacheRecord = false;
+    /* compare the cached tables with the computed ones of the next delivery */
+    mDqeTableCacheVerify = mDqeBlobFromCache;
+    mDqeTableCacheVerifyKey = mDqeTableCacheKey;
+
     return NO_ERROR;
 }
 
+int32_t ExynosDisplayDrmInterfaceModule::prepareDisplayColorBlobs(
+        const IDisplayColorGS101::IDqe &dqe)
+{
+    const auto prepare = [&](const DrmProperty &prop, uint32_t type,
+                             const auto &stage) -> int32_t {
+        if (!prop.id() || !stage.enable || !stage.dirty)
+            return NO_ERROR;
+        return createDqeStageBlob(type, dqe, mPreparedDqeBlobs[type]);
+    };
+
+    int32_t ret = NO_ERROR;
+    if ((ret = prepare(mDrmCrtc->cgc_lut_property(), DqeBlobs::CGC, dqe.Cgc())) ||
+        (ret = prepare(mDrmCrtc->degamma_lut_property(), DqeBlobs::DEGAMMA_LUT,
+                       dqe.DegammaLut())) ||
+        (ret = prepare(mDrmCrtc->gamma_lut_property(), DqeBlobs::REGAMMA_LUT,
+                       dqe.RegammaLut())) ||
+        (ret = prepare(mDrmCrtc->gamma_matrix_property(), DqeBlobs::GAMMA_MAT,
+                       dqe.GammaMatrix())) ||
+        (ret = prepare(mDrmCrtc->linear_matrix_property(), DqeBlobs::LINEAR_MAT,
+                       dqe.LinearMatrix())) ||
+        (ret = prepare(mDrmCrtc->disp_dither_property(), DqeBlobs::DISP_DITHER,
+                       dqe.DqeControl())) ||
+        (ret = prepare(mDrmCrtc->cgc_dither_property(), DqeBlobs::CGC_DITHER,
+                       dqe.DqeControl())))
+        ALOGE("%s: create blob fail (%d)", __func__, ret);
+
+    /* stages that were not prepared are created on the commit path */
+    return ret;
+}
+
+void ExynosDisplayDrmInterfaceModule::prepareDisplayColorBlobsAsync()
+{
+    if (isPrimary() == false)
+        return;
+
+    ExynosDeviceModule *device = (ExynosDeviceModule *)mExynosDisplay->mDevice;
+    ColorWorkerPool *pool = device->getDisplayColorWorkerPool();
+    /* the DQE table cache is only accessed from the commit path */
+    if ((pool == nullptr) || mDqePrepare.valid() || mDqeTableCacheLookup ||
+        mDqeTableCacheRecord || mDqeTableCacheVerify || mColorUpdateSuspended)
+        return;
+
+    ExynosPrimaryDisplayModule *display = (ExynosPrimaryDisplayModule *)mExynosDisplay;
+    const IDisplayColorGS101::IDqe &dqe = display->getDqe();
+    mDqePrepare = pool->post([this, &dqe]() { return prepareDisplayColorBlobs(dqe); });
+}
+
+void ExynosDisplayDrmInterfaceModule::waitDisplayColorBlobs()
+{
+    if (mDqePrepare.valid())
+        mDqePrepare.get();
+}
+
+void ExynosDisplayDrmInterfaceModule::releasePreparedDqeBlobs()
+{
+    for (auto &blobId : mPreparedDqeBlobs) {
+        if (blobId == 0)
+            continue;
+        mDrmDevice->DestroyPropertyBlob(blobId);
+        mColorCommitStats.blobDestroyed(blobId);
+        blobId = 0;
+    }
+}
+
+int32_t ExynosDisplayDrmInterfaceModule::createDppStageBlob(
+        const uint32_t type, const IDisplayColorGS101::IDpp &dpp, uint32_t &blobId)
+{
+    switch (type) {
+        case DppBlobs::EOTF:
+            return createEotfBlobFromIDpp(dpp, blobId);
+        case DppBlobs::GM:
+            return createGmBlobFromIDpp(dpp, blobId);
+        case DppBlobs::DTM:
+            return createDtmBlobFromIDpp(dpp, blobId);
+        case DppBlobs::OETF:
+            return createOetfBlobFromIDpp(dpp, blobId);
+        default:
+            return -EINVAL;
+    }
+}
+
+int32_t ExynosDisplayDrmInterfaceModule::prepareDppBlobs(
+        const IDisplayColorGS101::IDpp &dpp, uint32_t dppIndex)
+{
+    auto &blobs = mPreparedDppBlobs[dppIndex];
+    const auto prepare = [&](uint32_t type, const auto &stage) -> int32_t {
+        if (!stage.enable || !stage.dirty)
+            return NO_ERROR;
+        return createDppStageBlob(type, dpp, blobs[type]);
+    };
+
+    int32_t ret = NO_ERROR;
+    if ((ret = prepare(DppBlobs::EOTF, dpp.EotfLut())) ||
+        (ret = prepare(DppBlobs::GM, dpp.Gm())) ||
+        (ret = prepare(DppBlobs::DTM, dpp.Dtm())) ||
+        (ret = prepare(DppBlobs::OETF, dpp.OetfLut())))
+        ALOGE("%s: dpp[%u] create blob fail (%d)", __func__, dppIndex, ret);
+
+    return ret;
+}
+
+void ExynosDisplayDrmInterfaceModule::preparePlaneColorBlobs()
+{
+    /* blobs left over by planes that were not updated */
+    releasePreparedDppBlobs();
+
+    if ((mColorSettingChanged == false) || (isPrimary() == false))
+        return;
+
+    ExynosDeviceModule *device = (ExynosDeviceModule *)mExynosDisplay->mDevice;
+    ColorWorkerPool *pool = device->getColorWorkerPool();
+    if (pool == nullptr)
+        return;
+
+    ScopedColorCommitTimer timer(mColorCommitStats.time);
+
+    ExynosPrimaryDisplayModule *display = (ExynosPrimaryDisplayModule *)mExynosDisplay;
+    const auto dpps = display->getDpps();
+    mPreparedDppBlobs.assign(dpps.size(), {});
+
+    /* the composition thread takes the first IDpp instead of waiting idle */
+    std::vector<std::future<int32_t>> results;
+    for (uint32_t i = 1; i < dpps.size(); i++) {
+        const IDisplayColorGS101::IDpp &dpp = dpps[i].get();
+        results.push_back(pool->post([this, &dpp, i]() { return prepareDppBlobs(dpp, i); }));
+    }
+    if (!dpps.empty())
+        prepareDppBlobs(dpps[0].get(), 0);
+    for (auto &result : results)
+        result.get();
+}
+
+void ExynosDisplayDrmInterfaceModule::beginPlaneColorFrame()
+{
+    /* the planes stopped using these blobs in the previous frame */
+    destroyOldBlobs(mDppBlobRefs.unreferenced);
+
+    mFrameStartDppBlobs.clear();
+    for (auto &dppBlobs : mOldDppBlobs) {
+        PlaneDppBlobs &planeBlobs = mFrameStartDppBlobs[dppBlobs.planeId];
+        planeBlobs.source = dppBlobs.source;
+        for (uint32_t type = 0; type < DppBlobs::DPP_BLOB_NUM; type++)
+            planeBlobs.blobs[type] = dppBlobs.getBlob(type);
+    }
+}
+
+ExynosDisplayDrmInterfaceModule::DppBlobs *ExynosDisplayDrmInterfaceModule::getOldDppBlobs(
+        uint32_t planeId)
+{
+    for (auto &dppBlobs : mOldDppBlobs) {
+        if (dppBlobs.planeId == planeId)
+            return &dppBlobs;
+    }
+    return nullptr;
+}
+
+void ExynosDisplayDrmInterfaceModule::releasePreparedDppBlobs()
+{
+    for (auto &blobs : mPreparedDppBlobs) {
+        for (auto &blobId : blobs) {
+            if (blobId == 0)
+                continue;
+            mDrmDevice->DestroyPropertyBlob(blobId);
+            mColorCommitStats.blobDestroyed(blobId);
+            blobId = 0;
+        }
+    }
+}
+
 template<typename StageDataType>
 int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorBlob(
         const std::unique_ptr<DrmPlane> &plane,
@@ -566,44 +803,33 @@ int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorBlob(
         const IDisplayColorGS101::IDpp &dpp,
         const uint32_t dppIndex,
         ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq,
-        bool forceUpdate)
+        bool forceUpdate,
+        uint32_t carriedBlobId)
 {
     /* dirty bit is valid only if enable is true */
     if (!prop.id() || (stage.enable && !stage.dirty && !forceUpdate))
         return NO_ERROR;
 
-    uint32_t ix = 0;
-    for (;ix < mOldDppBlobs.size(); ix++) {
-        if (mOldDppBlobs[ix].planeId == plane->id()) {
-            break;
-        }
-    }
-    if (ix >= mOldDppBlobs.size()) {
+    DppBlobs *oldDppBlobs = getOldDppBlobs(plane->id());
+    if (oldDppBlobs == nullptr) {
         HWC_LOGE(mExynosDisplay, "%s: could not find plane %d", __func__, plane->id());
         return -EINVAL;
     }
-    DppBlobs &oldDppBlobs = mOldDppBlobs[ix];
 
     int32_t ret = 0;
     uint32_t blobId = 0;
 
-    if (stage.enable) {
-        switch (type) {
-            case DppBlobs::EOTF:
-                ret = createEotfBlobFromIDpp(dpp, blobId);
-                break;
-            case DppBlobs::GM:
-                ret = createGmBlobFromIDpp(dpp, blobId);
-                break;
-            case DppBlobs::DTM:
-                ret = createDtmBlobFromIDpp(dpp, blobId);
-                break;
-            case DppBlobs::OETF:
-                ret = createOetfBlobFromIDpp(dpp, blobId);
-                break;
-            default:
-                ret = -EINVAL;
-        }
+    if (stage.enable && !stage.dirty && (carriedBlobId != 0)) {
+        /* unchanged stage of a layer moving from another plane */
+        blobId = carriedBlobId;
+        mColorCommitStats.carriedBlobs++;
+    } else if (stage.enable && (dppIndex < mPreparedDppBlobs.size()) &&
+        (mPreparedDppBlobs[dppIndex][type] != 0)) {
+        /* created from the same IDpp data by preparePlaneColorBlobs() */
+        blobId = mPreparedDppBlobs[dppIndex][type];
+        mPreparedDppBlobs[dppIndex][type] = 0;
+    } else if (stage.enable) {
+        ret = createDppStageBlob(type, dpp, blobId);
         if (ret != NO_ERROR) {
             HWC_LOGE(mExynosDisplay, "%s: create blob fail", __func__);
             return ret;
@@ -611,16 +837,16 @@ int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorBlob(
     }
 
     /* Skip setting when previous and current setting is same with 0 */
-    if ((blobId == 0) && (oldDppBlobs.getBlob(type) == 0) && !forceUpdate)
+    if ((blobId == 0) && (oldDppBlobs->getBlob(type) == 0) && !forceUpdate)
         return ret;
 
-    if ((ret = drmReq.atomicAddProperty(plane->id(), prop, blobId)) < 0) {
+    if ((ret = addColorProperty(drmReq, plane->id(), prop, blobId)) < 0) {
         HWC_LOGE(mExynosDisplay, "%s: Fail to set property",
                 __func__);
         return ret;
     }
 
-    oldDppBlobs.addBlob(type, blobId);
+    oldDppBlobs->addBlob(type, blobId);
     stage.NotifyDataApplied();
 
     return ret;
@@ -635,6 +861,8 @@ int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorSetting(
         (isPrimary() == false))
         return NO_ERROR;
 
+    ScopedColorCommitTimer timer(mColorCommitStats.time);
+
     if ((config.assignedMPP == nullptr) ||
         (config.assignedMPP->mAssignedSources.size() == 0)) {
         HWC_LOGE(mExynosDisplay, "%s:: config's mpp source size is invalid",
@@ -683,37 +911,71 @@ int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorSetting(
 
     const IDisplayColorGS101::IDpp &dpp = display->getDppForLayer(mppSource);
     const uint32_t dppIndex = static_cast<uint32_t>(display->getDppIndexForLayer(mppSource));
-    bool planeChanged = display->checkAndSaveLayerPlaneId(mppSource, plane->id());
+    uint32_t prevPlaneId = UINT_MAX;
+    bool planeChanged =
+            display->checkAndSaveLayerPlaneId(mppSource, plane->id(), &prevPlaneId);
+    DppBlobs *oldDppBlobs = getOldDppBlobs(plane->id());
+    if (oldDppBlobs == nullptr) {
+        HWC_LOGE(mExynosDisplay, "%s: could not find plane %d", __func__, plane->id());
+        return -EINVAL;
+    }
+    /*
+     * Every stage of a plane whose blobs were reclaimed or set for another
+     * source is set again.
+     */
+    if (oldDppBlobs->isReclaimed() || (oldDppBlobs->source != mppSource)) {
+        planeChanged = true;
+        oldDppBlobs->clearReclaimed();
+    }
+
+    /*
+     * Blob ids are not plane specific. A layer moving from another plane
+     * takes the blobs it had there at the start of the frame for the stages
+     * displaycolor did not change, only dirty stages are created again.
+     */
+    std::array<uint32_t, DppBlobs::DPP_BLOB_NUM> carried{};
+    if (planeChanged && (prevPlaneId != plane->id())) {
+        auto it = mFrameStartDppBlobs.find(prevPlaneId);
+        if ((it != mFrameStartDppBlobs.end()) && (it->second.source == mppSource))
+            carried = it->second.blobs;
+    }
+    /* set again on the next frame if one of the stages fails */
+    oldDppBlobs->source = nullptr;
 
     int ret = 0;
     if ((ret = setPlaneColorBlob(plane, plane->eotf_lut_property(),
                 static_cast<uint32_t>(DppBlobs::EOTF),
-                dpp.EotfLut(), dpp, dppIndex, drmReq, planeChanged) != NO_ERROR)) {
+                dpp.EotfLut(), dpp, dppIndex, drmReq, planeChanged,
+                carried[DppBlobs::EOTF]) != NO_ERROR)) {
         HWC_LOGE(mExynosDisplay, "%s: dpp[%d] set oetf blob fail",
                 __func__, dppIndex);
         return ret;
     }
     if ((ret = setPlaneColorBlob(plane, plane->gammut_matrix_property(),
                 static_cast<uint32_t>(DppBlobs::GM),
-                dpp.Gm(), dpp, dppIndex, drmReq, planeChanged) != NO_ERROR)) {
+                dpp.Gm(), dpp, dppIndex, drmReq, planeChanged,
+                carried[DppBlobs::GM]) != NO_ERROR)) {
         HWC_LOGE(mExynosDisplay, "%s: dpp[%d] set GM blob fail",
                 __func__, dppIndex);
         return ret;
     }
     if ((ret = setPlaneColorBlob(plane, plane->tone_mapping_property(),
                 static_cast<uint32_t>(DppBlobs::DTM),
-                dpp.Dtm(), dpp, dppIndex, drmReq, planeChanged) != NO_ERROR)) {
+                dpp.Dtm(), dpp, dppIndex, drmReq, planeChanged,
+                carried[DppBlobs::DTM]) != NO_ERROR)) {
         HWC_LOGE(mExynosDisplay, "%s: dpp[%d] set DTM blob fail",
                 __func__, dppIndex);
         return ret;
     }
     if ((ret = setPlaneColorBlob(plane, plane->oetf_lut_property(),
                 static_cast<uint32_t>(DppBlobs::OETF),
-                dpp.OetfLut(), dpp, dppIndex, drmReq, planeChanged) != NO_ERROR)) {
+                dpp.OetfLut(), dpp, dppIndex, drmReq, planeChanged,
+                carried[DppBlobs::OETF]) != NO_ERROR)) {
         HWC_LOGE(mExynosDisplay, "%s: dpp[%d] set OETF blob fail",
                 __func__, dppIndex);
         return ret;
     }
+    oldDppBlobs->source = mppSource;
 
     return 0;
 }
@@ -721,11 +983,33 @@ int32_t ExynosDisplayDrmInterfaceModule::setPlaneColorSetting(
 ExynosDisplayDrmInterfaceModule::SaveBlob::~SaveBlob()
 {
     for (auto &it: blobs) {
-        mDrmDevice->DestroyPropertyBlob(it);
+        destroyBlob(it);
     }
     blobs.clear();
 }
 
+void ExynosDisplayDrmInterfaceModule::SaveBlob::destroyBlob(uint32_t blob)
+{
+    if (blob == 0)
+        return;
+    if (mRefs) {
+        mRefs->release(blob);
+        return;
+    }
+    mDrmDevice->DestroyPropertyBlob(blob);
+    if (mStats)
+        mStats->blobDestroyed(blob);
+}
+
+void ExynosDisplayDrmInterfaceModule::SaveBlob::reclaim()
+{
+    for (auto &it: blobs) {
+        destroyBlob(it);
+        it = 0;
+    }
+    mReclaimed = true;
+}
+
 void ExynosDisplayDrmInterfaceModule::SaveBlob::addBlob(
         uint32_t type, uint32_t blob)
 {
@@ -733,12 +1017,38 @@ void ExynosDisplayDrmInterfaceModule::SaveBlob::addBlob(
         ALOGE("Invalid dqe blop type: %d", type);
         return;
     }
+    /* take the new reference first, the blob may be the one replaced */
+    if (mRefs && (blob > 0))
+        mRefs->acquire(blob);
     if (blobs[type] > 0)
-        mDrmDevice->DestroyPropertyBlob(blobs[type]);
+        destroyBlob(blobs[type]);
 
     blobs[type] = blob;
 }
 
+void ExynosDisplayDrmInterfaceModule::BlobRefs::acquire(uint32_t blob)
+{
+    if (counts[blob]++ > 0)
+        return;
+    /* released earlier in the frame, e.g. by the plane it is carried from */
+    auto it = std::find(unreferenced.begin(), unreferenced.end(), blob);
+    if (it != unreferenced.end())
+        unreferenced.erase(it);
+}
+
+void ExynosDisplayDrmInterfaceModule::BlobRefs::release(uint32_t blob)
+{
+    auto it = counts.find(blob);
+    if (it == counts.end()) {
+        ALOGE("%s: blob %u is not referenced", __func__, blob);
+        return;
+    }
+    if (--it->second > 0)
+        return;
+    counts.erase(it);
+    unreferenced.push_back(blob);
+}
+
 uint32_t ExynosDisplayDrmInterfaceModule::SaveBlob::getBlob(uint32_t type)
 {
     if (type >= blobs.size()) {
@@ -748,10 +1058,116 @@ uint32_t ExynosDisplayDrmInterfaceModule::SaveBlob::getBlob(uint32_t type)
     return blobs[type];
 }
 
+int32_t ExynosDisplayDrmInterfaceModule::createColorBlob(const void *data, size_t size,
+                                                         uint32_t &blobId)
+{
+    int ret = mDrmDevice->CreatePropertyBlob(const_cast<void *>(data), size, &blobId);
+    if (ret == 0)
+        mColorCommitStats.blobCreated(blobId, size);
+    return ret;
+}
+
+void ExynosDisplayDrmInterfaceModule::ColorCommitStats::blobCreated(uint32_t blobId, size_t size)
+{
+    std::lock_guard<std::mutex> lock(blobMutex);
+    blobCreates++;
+    blobCreateBytes += size;
+    liveBlobSizes[blobId] = size;
+    liveBlobBytes += size;
+}
+
+void ExynosDisplayDrmInterfaceModule::ColorCommitStats::blobDestroyed(uint32_t blobId)
+{
+    std::lock_guard<std::mutex> lock(blobMutex);
+    blobDestroys++;
+    auto it = liveBlobSizes.find(blobId);
+    if (it == liveBlobSizes.end())
+        return;
+    liveBlobBytes -= it->second;
+    liveBlobSizes.erase(it);
+}
+
+uint64_t ExynosDisplayDrmInterfaceModule::ColorCommitStats::getLiveBlobBytes()
+{
+    std::lock_guard<std::mutex> lock(blobMutex);
+    return liveBlobBytes;
+}
+
+void ExynosDisplayDrmInterfaceModule::reclaimColorBlobs()
+{
+    waitDisplayColorBlobs();
+    releasePreparedDqeBlobs();
+    releasePreparedDppBlobs();
+
+    const uint64_t liveBytes = getLiveColorBlobBytes();
+    mOldDqeBlobs.reclaim();
+    for (auto &dppBlobs : mOldDppBlobs) {
+        dppBlobs.reclaim();
+        dppBlobs.source = nullptr;
+    }
+    mFrameStartDppBlobs.clear();
+    destroyOldBlobs(mDppBlobRefs.unreferenced);
+    mOldHistoBlobs.reclaim();
+
+    mDqeCheckpointValid = false;
+    mDqeRepushMask = 0;
+    mColorCommitStats.reclaims++;
+    mColorCommitStats.reclaimedBytes += liveBytes - getLiveColorBlobBytes();
+}
+
+int32_t ExynosDisplayDrmInterfaceModule::addColorProperty(
+        ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq, uint32_t objectId,
+        const DrmProperty &prop, uint64_t value, bool optional)
+{
+    int32_t ret = drmReq.atomicAddProperty(objectId, prop, value, optional);
+    if (ret >= 0)
+        mColorCommitStats.properties++;
+    return ret;
+}
+
+void ExynosDisplayDrmInterfaceModule::dumpColorCommitStats(String8 &result)
+{
+    ColorCommitStats &stats = mColorCommitStats;
+    const uint64_t frames = stats.frames ? stats.frames : 1;
+
+    result.appendFormat("Color commit: frames %" PRIu64 ", %" PRId64 " ns/frame\n",
+                        stats.frames, stats.time / static_cast<nsecs_t>(frames));
+    {
+        std::lock_guard<std::mutex> lock(stats.blobMutex);
+        result.appendFormat("\tblob create %" PRIu64 " (%" PRIu64 " bytes, %" PRIu64
+                            " bytes/frame), blob destroy %" PRIu64 "\n",
+                            stats.blobCreates, stats.blobCreateBytes,
+                            stats.blobCreateBytes / frames, stats.blobDestroys);
+        result.appendFormat("\tlive blobs %zu (%" PRIu64 " bytes), reclaimed %" PRIu64
+                            " times (%" PRIu64 " bytes)\n",
+                            stats.liveBlobSizes.size(), stats.liveBlobBytes, stats.reclaims,
+                            stats.reclaimedBytes);
+    }
+    result.appendFormat("\tatomic properties %" PRIu64 " (%" PRIu64 "/frame)\n",
+                        stats.properties, stats.properties / frames);
+    result.appendFormat("\tdqe checkpoint restore %" PRIu64 ", miss %" PRIu64
+                        ", repush after readback %" PRIu64 "\n",
+                        stats.checkpointRestores, stats.checkpointMisses, stats.repushes);
+    result.appendFormat("\tdqe updates deferred in %" PRIu64 " suspended frames\n",
+                        stats.suspendedFrames);
+    result.appendFormat("\tdpp blobs carried to a new plane %" PRIu64 "\n",
+                        stats.carriedBlobs);
+}
+
 void ExynosDisplayDrmInterfaceModule::getDisplayInfo(
         std::vector<displaycolor::DisplayInfo> &display_info) {
-    displaycolor::DisplayInfo primary_display;
-    auto &tb = primary_display.brightness_table;
+    display_info.push_back(*getDisplayInfoSnapshot());
+}
+
+std::shared_ptr<const displaycolor::DisplayInfo>
+ExynosDisplayDrmInterfaceModule::getDisplayInfoSnapshot() {
+    ExynosPrimaryDisplayModule* display = (ExynosPrimaryDisplayModule*)mExynosDisplay;
+    const std::string &sysfs = display->getPanelSysfsPath(display->getBuiltInDisplayType());
+    if (mDisplayInfo != nullptr && sysfs == mDisplayInfoSysfs)
+        return mDisplayInfo;
+
+    auto primary_display = std::make_shared<displaycolor::DisplayInfo>();
+    auto &tb = primary_display->brightness_table;
     auto *brightnessTable = mExynosDisplay->mBrightnessController->getBrightnessTable();
 
     tb.nbm_nits_min = brightnessTable[toUnderlying(BrightnessRange::NORMAL)].mNitsStart;
@@ -764,10 +1180,29 @@ void ExynosDisplayDrmInterfaceModule::getDisplayInfo(
     tb.hbm_dbv_min = brightnessTable[toUnderlying(BrightnessRange::HBM)].mBklStart;
     tb.hbm_dbv_max = brightnessTable[toUnderlying(BrightnessRange::HBM)].mBklEnd;
 
-    primary_display.panel_name = GetPanelName();
-    primary_display.panel_serial = GetPanelSerial();
+    primary_display->panel_name = GetPanelName();
+    primary_display->panel_serial = GetPanelSerial();
+    mPanelSerial = primary_display->panel_serial;
+    mDqeTablePanelKeyValid = false;
+
+    mDisplayInfo = std::move(primary_display);
+    mDisplayInfoSysfs = sysfs;
+    return mDisplayInfo;
+}
+
+bool ExynosDisplayDrmInterfaceModule::refreshDisplayInfo() {
+    if (mDisplayInfo == nullptr) return false;
+
+    const std::string serial = GetPanelSerial();
+    if (serial == mDisplayInfo->panel_serial) return false;
 
-    display_info.push_back(primary_display);
+    ALOGI("%s: panel serial changed from %s to %s", __func__,
+          mDisplayInfo->panel_serial.c_str(), serial.c_str());
+    mDisplayInfo.reset();
+    getDisplayInfoSnapshot();
+    /* the DQE blobs of the last delivery were computed for the other panel */
+    mDqeCheckpointValid = false;
+    return true;
 }
 
 const std::string ExynosDisplayDrmInterfaceModule::GetPanelInfo(const std::string &sysfs_rel,
@@ -789,6 +1224,81 @@ const std::string ExynosDisplayDrmInterfaceModule::GetPanelInfo(const std::strin
     return info;
 }
 
+/* For DQE table cache */
+uint32_t ExynosDisplayDrmInterfaceModule::getDqeTableSize(const uint32_t type) {
+    constexpr size_t kLutLen = IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen;
+
+    switch (type) {
+        case DqeBlobs::CGC:
+            return sizeof(struct cgc_lut);
+        case DqeBlobs::DEGAMMA_LUT:
+        case DqeBlobs::REGAMMA_LUT:
+            return sizeof(struct drm_color_lut) * kLutLen;
+        case DqeBlobs::GAMMA_MAT:
+        case DqeBlobs::LINEAR_MAT:
+            return sizeof(struct exynos_matrix);
+        default:
+            /* dither registers are not cached */
+            return 0;
+    }
+}
+
+void ExynosDisplayDrmInterfaceModule::updateDqeTableCacheKey() {
+    if (mDqeTableCache == nullptr) {
+        mDqeTableCacheRecord = false;
+        return;
+    }
+
+    if (!mDqeTablePanelKeyValid) {
+        ExynosPrimaryDisplayModule *display = (ExynosPrimaryDisplayModule *)mExynosDisplay;
+        ExynosDeviceModule *device = (ExynosDeviceModule *)mExynosDisplay->mDevice;
+        const uint32_t calibration =
+                static_cast<uint32_t>(display->getPanelCalibrationStatus());
+
+        mDqeTablePanelKey = DqeTableCache::makePanelKey(mPanelSerial,
+                                                        *device->getDisplayColorVersion(),
+                                                        calibration);
+        mDqeTablePanelKeyValid = true;
+    }
+    mDqeTableCacheKey = DqeTableCache::makeKey(mDqeTablePanelKey, mDqeBootSceneHash);
+    /*
+     * Record a forced delivery of a new key, and the delivery after a cached
+     * one so entries that no longer match displaycolor, e.g. after the panel
+     * was recalibrated, are replaced.
+     */
+    const bool verify = mDqeTableCacheVerify && (mDqeTableCacheVerifyKey == mDqeTableCacheKey);
+    mDqeTableCacheRecord = !mPanelSerial.empty() &&
+            ((mForceDisplayColorSetting && !mDqeTableCache->hasKey(mDqeTableCacheKey)) ||
+             verify);
+    mDqeTableCacheVerify = false;
+}
+
+bool ExynosDisplayDrmInterfaceModule::createDqeBlobFromCache(const uint32_t type,
+                                                             uint32_t &blobId) {
+    const uint32_t size = getDqeTableSize(type);
+    if ((size == 0) || (mDqeTableCache == nullptr)) return false;
+
+    const void *data = mDqeTableCache->find(mDqeTableCacheKey, type, size);
+    if (data == nullptr) return false;
+
+    if (createColorBlob(data, size, blobId)) {
+        blobId = 0;
+        return false;
+    }
+    return true;
+}
+
+int32_t ExynosDisplayDrmInterfaceModule::createDqeBlob(const uint32_t type, const void *data,
+                                                       uint32_t size, uint32_t &blobId) {
+    int ret = createColorBlob(data, size, blobId);
+    if (ret) return ret;
+
+    if (mDqeTableCacheRecord && (getDqeTableSize(type) == size))
+        mDqeTableCache->store(mDqeTableCacheKey, type, data, size);
+
+    return NO_ERROR;
+}
+
 /* For Histogram */
 int32_t ExynosDisplayDrmInterfaceModule::createHistoRoiBlob(uint32_t &blobId) {
     struct histogram_roi histo_roi;
@@ -798,7 +1308,7 @@ int32_t ExynosDisplayDrmInterfaceModule::createHistoRoiBlob(uint32_t &blobId) {
     histo_roi.hsize = mHistogramInfo->getHistogramROI().hsize;
     histo_roi.vsize = mHistogramInfo->getHistogramROI().vsize;
 
-    int ret = mDrmDevice->CreatePropertyBlob(&histo_roi, sizeof(histo_roi), &blobId);
+    int ret = createColorBlob(&histo_roi, sizeof(histo_roi), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create histogram roi blob %d", ret);
         return ret;
@@ -814,7 +1324,7 @@ int32_t ExynosDisplayDrmInterfaceModule::createHistoWeightsBlob(uint32_t &blobId
     histo_weights.weight_g = mHistogramInfo->getHistogramWeights().weight_g;
     histo_weights.weight_b = mHistogramInfo->getHistogramWeights().weight_b;
 
-    int ret = mDrmDevice->CreatePropertyBlob(&histo_weights, sizeof(histo_weights), &blobId);
+    int ret = createColorBlob(&histo_weights, sizeof(histo_weights), blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create histogram weights blob %d", ret);
         return ret;
@@ -849,7 +1359,7 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayHistoBlob(
     /* Skip setting when previous and current setting is same with 0 */
     if ((blobId == 0) && (mOldHistoBlobs.getBlob(type) == 0)) return ret;
 
-    if ((ret = drmReq.atomicAddProperty(mDrmCrtc->id(), prop, blobId)) < 0) {
+    if ((ret = addColorProperty(drmReq, mDrmCrtc->id(), prop, blobId)) < 0) {
         HWC_LOGE(mExynosDisplay, "%s: Failed to add property", __func__);
         return ret;
     }
@@ -861,6 +1371,8 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayHistoBlob(
 int32_t ExynosDisplayDrmInterfaceModule::setDisplayHistogramSetting(
         ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq) {
     if ((mHistogramInfoRegistered == false) || (isPrimary() == false)) return NO_ERROR;
+    /* histogram blobs are rebuilt every frame, the next active frame restores them */
+    if (mColorUpdateSuspended) return NO_ERROR;
 
     int ret = NO_ERROR;
 
@@ -878,7 +1390,7 @@ int32_t ExynosDisplayDrmInterfaceModule::setDisplayHistogramSetting(
 
     const DrmProperty &prop_histo_threshold = mDrmCrtc->histogram_threshold_property();
     if (prop_histo_threshold.id()) {
-        if ((ret = drmReq.atomicAddProperty(mDrmCrtc->id(), prop_histo_threshold,
+        if ((ret = addColorProperty(drmReq, mDrmCrtc->id(), prop_histo_threshold,
                                             (uint64_t)(mHistogramInfo->getHistogramThreshold()),
                                             true)) < 0) {
             HWC_LOGE(mExynosDisplay, "%s: Failed to set histogram thereshold property", __func__);
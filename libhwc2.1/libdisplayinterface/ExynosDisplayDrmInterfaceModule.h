@@ -20,6 +20,12 @@
 #include <gs101/displaycolor/displaycolor_gs101.h>
 #include <gs101/histogram/histogram.h>
 
+#include <array>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+#include "DqeTableCache.h"
 #include "ExynosDisplayDrmInterface.h"
 
 namespace gs101 {
@@ -43,6 +49,51 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
             mForceDisplayColorSetting = forceDisplay;
         };
         void destroyOldBlobs(std::vector<uint32_t> &oldBlobs);
+        /*
+         * Hash of the scene state the DQE stages of the next delivery are computed
+         * from, and its part that keys the DQE table cache
+         */
+        void setDqeSceneHash(uint64_t hash, uint64_t bootHash) {
+            mDqeSceneHash = hash;
+            mDqeBootSceneHash = bootHash;
+        }
+        /*
+         * Reuse the blobs of the last DQE delivery for the next forced delivery if
+         * the scene is unchanged, e.g. when the display is switched back on.
+         */
+        void requestDqeCheckpointRestore() { mDqeCheckpointRestoreRequested = true; }
+        /*
+         * Push the DQE stages delivered by the last frame again on the next
+         * delivery, reusing their blobs unless displaycolor changed them.
+         */
+        void requestDqeRepush() { mDqeRepushMask |= mDqeDeliveredMask; }
+        /*
+         * Defer non-forced DQE and histogram updates, e.g. in doze. Deferred
+         * DQE stages stay dirty and are delivered together on the next active
+         * frame; DPP stages of the planes are still delivered.
+         */
+        void setColorUpdateSuspended(bool suspended) { mColorUpdateSuspended = suspended; }
+        /*
+         * Create the blobs of the dirty DQE stages on the device color worker
+         * pool while every built-in display is on. setDisplayColorSetting()
+         * joins it, so the blobs are built while the frame and its planes are
+         * set up; the next displaycolor Update() joins it as well. Blobs the
+         * next setDisplayColorSetting() does not use are destroyed.
+         */
+        void prepareDisplayColorBlobsAsync();
+        void waitDisplayColorBlobs();
+        /*
+         * Create the blobs of the dirty DPP stages of every IDpp in parallel on
+         * the device color worker pool, if enabled, so the per plane
+         * setPlaneColorSetting() calls only add the properties.
+         */
+        void preparePlaneColorBlobs();
+        /*
+         * Start the plane color setting of a frame: destroy the DPP blobs no
+         * plane uses anymore and record the blobs of every plane, so a layer
+         * moving to another plane can carry the blobs of its clean stages.
+         */
+        void beginPlaneColorFrame();
 
         int32_t createCgcBlobFromIDqe(const IDisplayColorGS101::IDqe &dqe,
                 uint32_t &blobId);
@@ -69,6 +120,17 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
                 uint32_t &blobId);
 
         void getDisplayInfo(std::vector<displaycolor::DisplayInfo> &display_info);
+        /*
+         * Panel identity and brightness table of the display, read once per
+         * panel. It is re-read when the panel sysfs path changes, e.g. when the
+         * built-in display switches to the other panel, or by refreshDisplayInfo().
+         */
+        std::shared_ptr<const displaycolor::DisplayInfo> getDisplayInfoSnapshot();
+        /*
+         * Re-read the panel serial, e.g. at power on after a hotplug, and rebuild
+         * the snapshot if another panel is connected. Returns true if it was rebuilt.
+         */
+        bool refreshDisplayInfo();
 
         /* For Histogram */
         int32_t createHistoRoiBlob(uint32_t &blobId);
@@ -91,19 +153,75 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
         int32_t setHistogramControl(int32_t enabled);
         virtual int32_t setHistogramData(void *bin);
 
+        /* Property blob and atomic property accounting of the color path */
+        struct ColorCommitStats {
+            uint64_t frames = 0;
+            uint64_t properties = 0;
+            uint64_t checkpointRestores = 0;
+            uint64_t checkpointMisses = 0;
+            uint64_t repushes = 0;
+            uint64_t suspendedFrames = 0;
+            uint64_t reclaims = 0;
+            uint64_t reclaimedBytes = 0;
+            uint64_t carriedBlobs = 0;
+            nsecs_t time = 0;
+
+            /* blobs can be created and destroyed from the color worker pool */
+            void blobCreated(uint32_t blobId, size_t size);
+            void blobDestroyed(uint32_t blobId);
+            uint64_t getLiveBlobBytes();
+
+            std::mutex blobMutex;
+            uint64_t blobCreates = 0;
+            uint64_t blobCreateBytes = 0;
+            uint64_t blobDestroys = 0;
+            /* size of every live blob created through createColorBlob() */
+            std::unordered_map<uint32_t, uint32_t> liveBlobSizes;
+            uint64_t liveBlobBytes = 0;
+        };
+        const ColorCommitStats &getColorCommitStats() const { return mColorCommitStats; }
+        void dumpColorCommitStats(String8 &result);
+        /* Bytes of the color property blobs of this display kept alive by HWC */
+        uint64_t getLiveColorBlobBytes() { return mColorCommitStats.getLiveBlobBytes(); }
+        /*
+         * Destroy the color blobs kept for the next delivery, e.g. at power off.
+         * The next delivery has to be forced and rebuilds every stage.
+         */
+        void reclaimColorBlobs();
+
     protected:
+        /* References of blobs that can be held by several SaveBlobs at once */
+        struct BlobRefs {
+            void acquire(uint32_t blob);
+            void release(uint32_t blob);
+
+            std::unordered_map<uint32_t, uint32_t> counts;
+            /* blobs released by their last holder, destroyed by the owner of the refs */
+            std::vector<uint32_t> unreferenced;
+        };
         class SaveBlob {
             public:
                 ~SaveBlob();
-                void init(DrmDevice *drmDevice, uint32_t size) {
+                void init(DrmDevice *drmDevice, uint32_t size, ColorCommitStats *stats,
+                          BlobRefs *refs = nullptr) {
                     mDrmDevice = drmDevice;
+                    mStats = stats;
+                    mRefs = refs;
                     blobs.resize(size, 0);
                 };
                 void addBlob(uint32_t type, uint32_t blob);
                 uint32_t getBlob(uint32_t type);
+                /* destroy all blobs, the kernel may still hold the last ones */
+                void reclaim();
+                bool isReclaimed() const { return mReclaimed; }
+                void clearReclaimed() { mReclaimed = false; }
             private:
+                void destroyBlob(uint32_t blob);
                 DrmDevice *mDrmDevice = NULL;
+                ColorCommitStats *mStats = nullptr;
+                BlobRefs *mRefs = nullptr;
                 std::vector<uint32_t> blobs;
+                bool mReclaimed = false;
         };
         class DqeBlobs:public SaveBlob {
             public:
@@ -117,8 +235,8 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
                     CGC_DITHER,
                     DQE_BLOB_NUM // number of DQE blobs
                 };
-                void init(DrmDevice *drmDevice) {
-                    SaveBlob::init(drmDevice, DQE_BLOB_NUM);
+                void init(DrmDevice *drmDevice, ColorCommitStats *stats) {
+                    SaveBlob::init(drmDevice, DQE_BLOB_NUM, stats);
                 };
         };
         class DppBlobs:public SaveBlob {
@@ -130,11 +248,29 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
                     OETF,
                     DPP_BLOB_NUM // number of DPP blobs
                 };
-                DppBlobs(DrmDevice *drmDevice, uint32_t pid) : planeId(pid) {
-                    SaveBlob::init(drmDevice, DPP_BLOB_NUM);
+                DppBlobs(DrmDevice *drmDevice, uint32_t pid, ColorCommitStats *stats,
+                         BlobRefs *refs)
+                      : planeId(pid) {
+                    SaveBlob::init(drmDevice, DPP_BLOB_NUM, stats, refs);
                 };
                 uint32_t planeId;
+                /* source whose stages the blobs were set for, nullptr if unknown */
+                ExynosMPPSource *source = nullptr;
         };
+        /* DppBlobs of a plane at the start of the frame */
+        struct PlaneDppBlobs {
+            ExynosMPPSource *source;
+            std::array<uint32_t, DppBlobs::DPP_BLOB_NUM> blobs;
+        };
+        int32_t createDqeStageBlob(const uint32_t type, const IDisplayColorGS101::IDqe &dqe,
+                                   uint32_t &blobId);
+        int32_t setDisplayColorStages(ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq);
+        int32_t prepareDisplayColorBlobs(const IDisplayColorGS101::IDqe &dqe);
+        void releasePreparedDqeBlobs();
+        int32_t createDppStageBlob(const uint32_t type, const IDisplayColorGS101::IDpp &dpp,
+                                   uint32_t &blobId);
+        int32_t prepareDppBlobs(const IDisplayColorGS101::IDpp &dpp, uint32_t dppIndex);
+        void releasePreparedDppBlobs();
         template<typename StageDataType>
         int32_t setDisplayColorBlob(
                 const DrmProperty &prop,
@@ -151,17 +287,30 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
                 const IDisplayColorGS101::IDpp &dpp,
                 const uint32_t dppIndex,
                 ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq,
-                bool forceUpdate);
+                bool forceUpdate,
+                uint32_t carriedBlobId);
         void parseBpcEnums(const DrmProperty& property);
+        /* declared before the SaveBlobs, which account their blobs in it until destroyed */
+        ColorCommitStats mColorCommitStats;
         DqeBlobs mOldDqeBlobs;
         std::vector<DppBlobs> mOldDppBlobs;
         void initOldDppBlobs(DrmDevice *drmDevice) {
             auto const &planes = drmDevice->planes();
             for (uint32_t ix = 0; ix < planes.size(); ++ix)
-                mOldDppBlobs.emplace_back(mDrmDevice, planes[ix]->id());
+                mOldDppBlobs.emplace_back(mDrmDevice, planes[ix]->id(), &mColorCommitStats,
+                                          &mDppBlobRefs);
         };
+        DppBlobs *getOldDppBlobs(uint32_t planeId);
+        /* a DPP blob moves with its layer, so several planes can hold it */
+        BlobRefs mDppBlobRefs;
+        /* indexed by plane id, recorded by beginPlaneColorFrame() */
+        std::unordered_map<uint32_t, PlaneDppBlobs> mFrameStartDppBlobs;
         bool mColorSettingChanged = false;
         bool mForceDisplayColorSetting = false;
+        int32_t createColorBlob(const void *data, size_t size, uint32_t &blobId);
+        int32_t addColorProperty(ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq,
+                                 uint32_t objectId, const DrmProperty &prop, uint64_t value,
+                                 bool optional = false);
         enum Bpc_Type {
             BPC_UNSPECIFIED = 0,
             BPC_8,
@@ -177,16 +326,76 @@ class ExynosDisplayDrmInterfaceModule : public ExynosDisplayDrmInterface {
                 WEIGHTS,
                 HISTO_BLOB_NUM // number of Histogram blobs
             };
-            void init(DrmDevice *drmDevice) { SaveBlob::init(drmDevice, HISTO_BLOB_NUM); }
+            void init(DrmDevice *drmDevice, ColorCommitStats *stats) {
+                SaveBlob::init(drmDevice, HISTO_BLOB_NUM, stats);
+            }
         };
         int32_t setDisplayHistoBlob(const DrmProperty &prop, const uint32_t type,
                                     ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq);
         HistoBlobs mOldHistoBlobs;
 
+        /* For DQE table cache */
+        static uint32_t getDqeTableSize(const uint32_t type);
+        void updateDqeTableCacheKey();
+        bool createDqeBlobFromCache(const uint32_t type, uint32_t &blobId);
+        int32_t createDqeBlob(const uint32_t type, const void *data, uint32_t size,
+                              uint32_t &blobId);
+        std::unique_ptr<DqeTableCache> mDqeTableCache;
+        uint64_t mDqeTableCacheKey = 0;
+        /* cached tables are used only for the first delivery after HWC start */
+        bool mDqeTableCacheLookup = true;
+        /* record payloads of a full delivery whose key is not in the cache yet */
+        bool mDqeTableCacheRecord = false;
+        /* the last delivery used cached tables of mDqeTableCacheVerifyKey */
+        bool mDqeTableCacheVerify = false;
+        uint64_t mDqeTableCacheVerifyKey = 0;
+        std::string mPanelSerial;
+        /* DqeTableCache::makePanelKey() of mPanelSerial, reset with the display info */
+        uint64_t mDqeTablePanelKey = 0;
+        bool mDqeTablePanelKeyValid = false;
+        uint64_t mDqeBootSceneHash = 0;
+
+        /* For DQE checkpoint, mOldDqeBlobs as delivered for mDqeCheckpointHash */
+        uint64_t mDqeSceneHash = 0;
+        uint64_t mDqeCheckpointHash = 0;
+        bool mDqeCheckpointValid = false;
+        bool mDqeCheckpointRestoreRequested = false;
+        /* set for the delivery that re-pushes the checkpoint blobs */
+        bool mDqeCheckpointRestore = false;
+        /* a blob of the current delivery came from the DQE table cache */
+        bool mDqeBlobFromCache = false;
+        /* DqeBlobs types whose property was set by the last delivery */
+        uint32_t mDqeDeliveredMask = 0;
+        /* DqeBlobs types to set on the next delivery even if not dirty */
+        uint32_t mDqeRepushMask = 0;
+        bool mColorUpdateSuspended = false;
+
+        /* For async DQE preparation, blobs not consumed by a delivery are destroyed */
+        std::future<int32_t> mDqePrepare;
+        std::array<uint32_t, DqeBlobs::DQE_BLOB_NUM> mPreparedDqeBlobs{};
+        /* indexed by dpp index */
+        std::vector<std::array<uint32_t, DppBlobs::DPP_BLOB_NUM>> mPreparedDppBlobs;
+
+        /*
+         * DQE LUTs converted to drm_color_lut. Blobs of one display are created
+         * by one DQE pass at a time, so the buffers are reused by every pass.
+         */
+        struct DqeLutStaging {
+            alignas(64) struct drm_color_lut
+                    degamma[IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen];
+            alignas(64) struct drm_color_lut regamma
+                    [IDisplayColorGS101::IDqe::RegammaLutData::ConfigType::kChannelLutLen];
+        };
+        DqeLutStaging mDqeLutStaging{};
+
         std::shared_ptr<HistogramInfo> mHistogramInfo;
         bool mHistogramInfoRegistered = false;
 
     private:
+        std::shared_ptr<const displaycolor::DisplayInfo> mDisplayInfo;
+        /* panel sysfs path mDisplayInfo was read from */
+        std::string mDisplayInfoSysfs;
+
         const std::string GetPanelInfo(const std::string &sysfs_rel, char delim);
         const std::string GetPanelSerial() { return GetPanelInfo("serial_number", '\n'); }
         const std::string GetPanelName() { return GetPanelInfo("panel_name", '\n'); }
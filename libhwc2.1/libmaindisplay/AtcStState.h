@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ATC_ST_STATE_H
+#define ATC_ST_STATE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+namespace gs101 {
+
+/* ATC strength dimming state, updated as a whole in one lock-free atomic */
+struct atc_st_state {
+    uint16_t strength;
+    uint16_t target;
+    /* remaining dimming steps */
+    uint16_t count;
+    uint8_t up_step;
+    uint8_t down_step;
+};
+static_assert(std::atomic<atc_st_state>::is_always_lock_free,
+              "atc_st_state must fit a lock-free atomic");
+
+constexpr uint32_t kAtcStKeepTarget = UINT32_MAX;
+
+/* Retarget to target (unless kAtcStKeepTarget) if needed and take one dimming step */
+inline atc_st_state advanceAtcStState(atc_st_state state, uint32_t target) {
+    if (target == kAtcStKeepTarget) target = state.target;
+    target = std::min<uint32_t>(target, UINT16_MAX);
+    /* a 0 step would never reach the target, the steps are at least 1 */
+    const uint32_t upStep = std::max<uint32_t>(state.up_step, 1);
+    const uint32_t downStep = std::max<uint32_t>(state.down_step, 1);
+    if (state.target != target) {
+        state.target = target;
+        uint32_t step = state.target > state.strength ? upStep : downStep;
+
+        int diff = state.target - state.strength;
+        state.count = std::min<uint32_t>((std::abs(diff) + step - 1) / step, UINT16_MAX);
+    }
+
+    if (state.count == 0) return state;
+
+    if ((state.strength + upStep) < state.target) {
+        state.strength = state.strength + upStep;
+    } else if (state.strength > (state.target + downStep)) {
+        state.strength = state.strength - downStep;
+    } else {
+        state.strength = state.target;
+    }
+    state.count--;
+    return state;
+}
+
+}  // namespace gs101
+
+#endif // ATC_ST_STATE_H
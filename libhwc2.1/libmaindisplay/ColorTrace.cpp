@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorTrace.h"
+
+#include <android-base/file.h>
+#include <android-base/threads.h>
+#include <android-base/unique_fd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace android;
+using namespace gs101;
+
+std::mutex ColorTrace::sRingsMutex;
+std::vector<std::unique_ptr<ColorTrace::ThreadRing>> ColorTrace::sRings;
+
+namespace {
+
+template <typename T>
+T getPayload(const ColorTrace::Record &record) {
+    T payload;
+    memcpy(&payload, record.payload, sizeof(T));
+    return payload;
+}
+
+void appendMatrix(String8 &result, const float *matrix) {
+    result.appendFormat("matrix\n");
+    for (uint32_t i = 0; i < 16; (i += 4)) {
+        result.appendFormat("%f, %f, %f, %f\n", matrix[i], matrix[i + 1], matrix[i + 2],
+                            matrix[i + 3]);
+    }
+}
+
+} // namespace
+
+ColorTrace::ThreadRing *ColorTrace::getThreadRing() {
+    thread_local ThreadRing *ring = nullptr;
+    if (ring == nullptr) {
+        auto newRing = std::make_unique<ThreadRing>();
+        newRing->tid = android::base::GetThreadId();
+        ring = newRing.get();
+
+        std::lock_guard<std::mutex> lock(sRingsMutex);
+        sRings.push_back(std::move(newRing));
+    }
+    return ring;
+}
+
+void ColorTrace::write(RecordType type, uint32_t display, uint16_t index, uint16_t count,
+                       const void *payload, size_t size) {
+    ThreadRing *ring = getThreadRing();
+    /* single writer per ring */
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    Record &record = ring->records[head % kRingSize];
+
+    record.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    record.type = type;
+    record.display = display;
+    record.index = index;
+    record.count = count;
+    memcpy(record.payload, payload, size);
+
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void ColorTrace::snapshot(const ThreadRing &ring, std::vector<Record> &records) {
+    const uint64_t end = ring.head.load(std::memory_order_acquire);
+    const uint64_t begin = (end > kRingSize) ? end - kRingSize : 0;
+
+    records.resize(end - begin);
+    for (uint64_t seq = begin; seq < end; seq++)
+        memcpy(&records[seq - begin], &ring.records[seq % kRingSize], sizeof(Record));
+
+    /* drop the records the writer may have overwritten while they were copied */
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+    const uint64_t valid = (head >= kRingSize) ? head - kRingSize + 1 : 0;
+    if (valid > begin)
+        records.erase(records.begin(),
+                      records.begin() + std::min<uint64_t>(valid - begin, records.size()));
+}
+
+void ColorTrace::dump(String8 &result, uint32_t display) {
+    std::vector<Record> records;
+    std::lock_guard<std::mutex> lock(sRingsMutex);
+
+    for (auto &ring : sRings) {
+        snapshot(*ring, records);
+
+        bool first = true;
+        for (auto &record : records) {
+            if (record.display != display) continue;
+            if (first) {
+                result.appendFormat("color trace (tid %d):\n", ring->tid);
+                first = false;
+            }
+            decode(record, result);
+        }
+    }
+}
+
+bool ColorTrace::save(const char *path) {
+    std::vector<uint8_t> image;
+    const auto append = [&image](const void *data, size_t size) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        image.insert(image.end(), bytes, bytes + size);
+    };
+
+    {
+        std::vector<Record> records;
+        std::lock_guard<std::mutex> lock(sRingsMutex);
+
+        const FileHeader header = {kFileMagic, kFileVersion, sizeof(Record),
+                                   static_cast<uint32_t>(sRings.size())};
+        append(&header, sizeof(header));
+        for (auto &ring : sRings) {
+            snapshot(*ring, records);
+            const RingHeader ringHeader = {ring->tid, static_cast<uint32_t>(records.size())};
+            append(&ringHeader, sizeof(ringHeader));
+            append(records.data(), records.size() * sizeof(Record));
+        }
+    }
+
+    android::base::unique_fd fd(::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if ((fd < 0) || !android::base::WriteFully(fd, image.data(), image.size())) {
+        ALOGE("%s: failed to write %s (%s)", __func__, path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void ColorTrace::decode(const Record &record, String8 &result) {
+    result.appendFormat("[%" PRId64 "] ", record.timestamp);
+
+    switch (record.type) {
+        case SCENE: {
+            auto scene = getPayload<Scene>(record);
+            result.appendFormat("======================= DisplayScene info "
+                                "========================\n");
+            result.appendFormat("dpu_bit_depth: %d\n", scene.dpuBitDepth);
+            result.appendFormat("color_mode: %d\n", scene.colorMode);
+            result.appendFormat("render_intent: %d\n", scene.renderIntent);
+            break;
+        }
+        case SCENE_MATRIX: {
+            auto matrix = getPayload<Matrix>(record);
+            appendMatrix(result, matrix.value);
+            result.appendFormat("layer: %u ++++++\n", record.count);
+            break;
+        }
+        case LAYER: {
+            auto layer = getPayload<Layer>(record);
+            result.appendFormat("layer[%d] info\n", record.index);
+            result.appendFormat("dataspace: 0x%8x\n", layer.dataspace);
+            break;
+        }
+        case LAYER_MATRIX: {
+            auto matrix = getPayload<Matrix>(record);
+            appendMatrix(result, matrix.value);
+            break;
+        }
+        case LAYER_STATIC_METADATA: {
+            auto st = getPayload<LayerStaticMetadata>(record);
+            result.appendFormat("static_metadata.is_valid(%d)\n", st.isValid);
+            if (st.isValid) {
+                result.appendFormat("\tdisplay_red_primary(%d, %d)\n", st.redPrimary[0],
+                                    st.redPrimary[1]);
+                result.appendFormat("\tdisplay_green_primary(%d, %d)\n", st.greenPrimary[0],
+                                    st.greenPrimary[1]);
+                result.appendFormat("\tdisplay_blue_primary(%d, %d)\n", st.bluePrimary[0],
+                                    st.bluePrimary[1]);
+                result.appendFormat("\twhite_point(%d, %d)\n", st.whitePoint[0],
+                                    st.whitePoint[1]);
+            }
+            break;
+        }
+        case LAYER_DYNAMIC_METADATA: {
+            auto dyn = getPayload<LayerDynamicMetadata>(record);
+            result.appendFormat("dynamic_metadata.is_valid(%d)\n", dyn.isValid);
+            if (dyn.isValid) {
+                result.appendFormat("\tdisplay_maximum_luminance: %d\n",
+                                    dyn.displayMaximumLuminance);
+                result.appendFormat("\tmaxscl(%d, %d, %d)\n", dyn.maxscl[0], dyn.maxscl[1],
+                                    dyn.maxscl[2]);
+                result.appendFormat("\ttm_flag(%d)\n", dyn.tmFlag);
+                result.appendFormat("\ttm_knee_x(%d)\n", dyn.tmKneeX);
+                result.appendFormat("\ttm_knee_y(%d)\n", dyn.tmKneeY);
+            }
+            break;
+        }
+        case LAYER_MAPPING: {
+            auto mapping = getPayload<LayerMapping>(record);
+            if (record.index == 0)
+                result.appendFormat("layerDataMappingInfo: %u ++++++\n", record.count);
+            result.appendFormat("[layer: 0x%" PRIx64 "] [%d, %d]\n", mapping.layer,
+                                mapping.dppIdx, mapping.planeId);
+            break;
+        }
+        case DISPLAY_COLOR_UPDATE:
+        case DISPLAY_COLOR_UPDATE_PRESENT: {
+            auto update = getPayload<DisplayColorUpdate>(record);
+            result.appendFormat("%s ret(%d) %" PRId64 " us\n",
+                                record.type == DISPLAY_COLOR_UPDATE ? "Update" : "UpdatePresent",
+                                update.ret, ns2us(update.duration));
+            break;
+        }
+        default:
+            result.appendFormat("unknown record type %u\n", record.type);
+            break;
+    }
+}
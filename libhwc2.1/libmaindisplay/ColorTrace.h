@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COLOR_TRACE_H
+#define COLOR_TRACE_H
+
+#include <sys/types.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* write the color trace rings to kColorTracePath on dumpsys */
+constexpr char kColorTraceSaveProp[] = "vendor.display.color.trace_save";
+constexpr char kColorTracePath[] = "/data/vendor/display/color_trace.bin";
+
+namespace gs101 {
+
+/*
+ * Low overhead trace of color path events and DisplayScene snapshots.
+ *
+ * Every thread writes fixed-size records into its own ring without locking;
+ * the ring is registered once on the first record of the thread and kept for
+ * the process lifetime so dump() can still decode it after the thread exits.
+ * Old records are overwritten when a ring wraps. decode() renders a record to
+ * the same text printDisplayScene() used to log.
+ *
+ * save() writes the rings for offline decoding:
+ *   FileHeader
+ *   { RingHeader, Record * RingHeader::recordCount } * FileHeader::ringCount
+ */
+class ColorTrace {
+    public:
+        enum RecordType : uint16_t {
+            SCENE,
+            SCENE_MATRIX,
+            LAYER,
+            LAYER_MATRIX,
+            LAYER_STATIC_METADATA,
+            LAYER_DYNAMIC_METADATA,
+            LAYER_MAPPING,
+            DISPLAY_COLOR_UPDATE,
+            DISPLAY_COLOR_UPDATE_PRESENT,
+        };
+
+        static constexpr size_t kPayloadSize = 64;
+        static constexpr size_t kRingSize = 512;
+
+        struct Record {
+            nsecs_t timestamp;
+            uint16_t type;
+            uint8_t display;
+            uint8_t reserved;
+            /* e.g. layer index, and number of layers or mappings of the scene */
+            uint16_t index;
+            uint16_t count;
+            uint8_t payload[kPayloadSize];
+        };
+
+        struct Scene {
+            uint32_t dpuBitDepth;
+            uint32_t colorMode;
+            uint32_t renderIntent;
+        };
+        struct Matrix {
+            float value[16];
+        };
+        struct Layer {
+            uint32_t dataspace;
+        };
+        struct LayerStaticMetadata {
+            uint32_t isValid;
+            uint32_t redPrimary[2];
+            uint32_t greenPrimary[2];
+            uint32_t bluePrimary[2];
+            uint32_t whitePoint[2];
+        };
+        struct LayerDynamicMetadata {
+            uint32_t isValid;
+            uint32_t displayMaximumLuminance;
+            uint32_t maxscl[3];
+            uint32_t tmFlag;
+            uint32_t tmKneeX;
+            uint32_t tmKneeY;
+        };
+        struct LayerMapping {
+            uint64_t layer;
+            uint32_t dppIdx;
+            uint32_t planeId;
+        };
+        struct DisplayColorUpdate {
+            int32_t ret;
+            uint32_t reserved;
+            nsecs_t duration;
+        };
+
+        static constexpr uint32_t kFileMagic = 0x52544344; // "DCTR"
+        static constexpr uint32_t kFileVersion = 1;
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            /* sizeof(Record) of the writer */
+            uint32_t recordSize;
+            uint32_t ringCount;
+        };
+        struct RingHeader {
+            int32_t tid;
+            uint32_t recordCount;
+        };
+
+        template <typename T>
+        static void record(RecordType type, uint32_t display, uint16_t index, uint16_t count,
+                           const T &payload) {
+            static_assert(sizeof(T) <= kPayloadSize, "payload does not fit in a record");
+            write(type, display, index, count, &payload, sizeof(T));
+        }
+
+        /* Decode the records of display from all threads into result */
+        static void dump(android::String8 &result, uint32_t display);
+        static void decode(const Record &record, android::String8 &result);
+        /* Write the records of all threads to path, oldest first in each ring */
+        static bool save(const char *path);
+
+    private:
+        struct ThreadRing {
+            pid_t tid;
+            std::atomic<uint64_t> head{0};
+            std::array<Record, kRingSize> records;
+        };
+
+        static ThreadRing *getThreadRing();
+        static void write(RecordType type, uint32_t display, uint16_t index, uint16_t count,
+                          const void *payload, size_t size);
+        static void snapshot(const ThreadRing &ring, std::vector<Record> &records);
+
+        static std::mutex sRingsMutex;
+        static std::vector<std::unique_ptr<ThreadRing>> sRings;
+};
+
+}  // namespace gs101
+
+#endif // COLOR_TRACE_H
@@ -38,6 +38,7 @@ class DisplayColorLoader {
                   ALOGE("%s: prebuilt lib is not versioned", __func__);
               } else {
                   auto intf_ver = get_version();
+                  lib_version = intf_ver;
 
                   if (intf_ver != nullptr &&
                       displaycolor::kInterfaceVersion.Compatible(*intf_ver)) {
@@ -72,7 +73,6 @@ class DisplayColorLoader {
               }
           } else {
               ALOGE("%s: failed to load library %s\n", __func__, lib_name);
-              get_display_color_gs101 = nullptr;
           }
       }
 
@@ -85,6 +85,10 @@ class DisplayColorLoader {
           return nullptr;
       }
 
+      const displaycolor::DisplayColorIntfVer *GetInterfaceVersion() const {
+          return lib_version != nullptr ? lib_version : &displaycolor::kInterfaceVersion;
+      }
+
       ~DisplayColorLoader() {
           if (lib_handle != nullptr) {
               dlclose(lib_handle);
@@ -93,8 +97,9 @@ class DisplayColorLoader {
 
     private:
       void *lib_handle;
+      const displaycolor::DisplayColorIntfVer *lib_version = nullptr;
       displaycolor::IDisplayColorGS101 *(*get_display_color_gs101)(
-              const std::vector<displaycolor::DisplayInfo> &);
+              const std::vector<displaycolor::DisplayInfo> &) = nullptr;
 };
 
 }  // namespace gs101
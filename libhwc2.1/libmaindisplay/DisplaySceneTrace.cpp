@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DisplaySceneTrace.h"
+
+#include <android-base/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <type_traits>
+
+using namespace gs101;
+using namespace displaycolor;
+
+namespace {
+
+class TraceWriter {
+    public:
+        explicit TraceWriter(std::vector<uint8_t> &out) : mOut(out) {}
+
+        template <typename T>
+        void put(const T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "not a plain field");
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+            mOut.insert(mOut.end(), bytes, bytes + sizeof(T));
+        }
+
+        template <typename T>
+        void putVector(const std::vector<T> &values) {
+            put(static_cast<uint32_t>(values.size()));
+            for (const auto &value : values) put(value);
+        }
+
+    private:
+        std::vector<uint8_t> &mOut;
+};
+
+class TraceReader {
+    public:
+        TraceReader(const uint8_t *cursor, const uint8_t *end) : mCursor(cursor), mEnd(end) {}
+
+        template <typename T>
+        bool get(T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "not a plain field");
+            if (static_cast<size_t>(mEnd - mCursor) < sizeof(T)) return false;
+            memcpy(&value, mCursor, sizeof(T));
+            mCursor += sizeof(T);
+            return true;
+        }
+
+        template <typename T>
+        bool getVector(std::vector<T> &values) {
+            uint32_t size;
+            if (!get(size) || (static_cast<size_t>(mEnd - mCursor) < size * sizeof(T)))
+                return false;
+            values.resize(size);
+            for (auto &value : values) get(value);
+            return true;
+        }
+
+        const uint8_t *cursor() const { return mCursor; }
+
+    private:
+        const uint8_t *mCursor;
+        const uint8_t *mEnd;
+};
+
+void putLayerColorData(TraceWriter &writer, const LayerColorData &layer) {
+    writer.put(layer.dataspace);
+    writer.put(layer.matrix);
+    writer.put(layer.dim_ratio);
+
+    const auto &st = layer.static_metadata;
+    writer.put(st.is_valid);
+    writer.put(st.display_red_primary_x);
+    writer.put(st.display_red_primary_y);
+    writer.put(st.display_green_primary_x);
+    writer.put(st.display_green_primary_y);
+    writer.put(st.display_blue_primary_x);
+    writer.put(st.display_blue_primary_y);
+    writer.put(st.white_point_x);
+    writer.put(st.white_point_y);
+    writer.put(st.max_luminance);
+    writer.put(st.min_luminance);
+    writer.put(st.max_content_light_level);
+    writer.put(st.max_frame_average_light_level);
+
+    const auto &dyn = layer.dynamic_metadata;
+    writer.put(dyn.is_valid);
+    writer.put(dyn.display_maximum_luminance);
+    writer.put(dyn.maxscl);
+    writer.putVector(dyn.maxrgb_percentages);
+    writer.putVector(dyn.maxrgb_percentiles);
+    writer.put(dyn.tm_flag);
+    writer.put(dyn.tm_knee_x);
+    writer.put(dyn.tm_knee_y);
+    writer.putVector(dyn.bezier_curve_anchors);
+}
+
+bool getLayerColorData(TraceReader &reader, LayerColorData &layer) {
+    auto &st = layer.static_metadata;
+    auto &dyn = layer.dynamic_metadata;
+
+    return reader.get(layer.dataspace) && reader.get(layer.matrix) &&
+            reader.get(layer.dim_ratio) && reader.get(st.is_valid) &&
+            reader.get(st.display_red_primary_x) && reader.get(st.display_red_primary_y) &&
+            reader.get(st.display_green_primary_x) && reader.get(st.display_green_primary_y) &&
+            reader.get(st.display_blue_primary_x) && reader.get(st.display_blue_primary_y) &&
+            reader.get(st.white_point_x) && reader.get(st.white_point_y) &&
+            reader.get(st.max_luminance) && reader.get(st.min_luminance) &&
+            reader.get(st.max_content_light_level) &&
+            reader.get(st.max_frame_average_light_level) && reader.get(dyn.is_valid) &&
+            reader.get(dyn.display_maximum_luminance) && reader.get(dyn.maxscl) &&
+            reader.getVector(dyn.maxrgb_percentages) &&
+            reader.getVector(dyn.maxrgb_percentiles) && reader.get(dyn.tm_flag) &&
+            reader.get(dyn.tm_knee_x) && reader.get(dyn.tm_knee_y) &&
+            reader.getVector(dyn.bezier_curve_anchors);
+}
+
+} // namespace
+
+DisplaySceneTrace::~DisplaySceneTrace() {
+    close();
+}
+
+bool DisplaySceneTrace::open(const std::string &path) {
+    close();
+
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (mFd < 0) {
+        ALOGE("%s: failed to create %s (%s)", __func__, path.c_str(), strerror(errno));
+        return false;
+    }
+
+    const FileHeader header = {kMagic, kFileVersion, kInterfaceVersion.major,
+                               kInterfaceVersion.minor};
+    if (!android::base::WriteFully(mFd, &header, sizeof(header))) {
+        ALOGE("%s: failed to write %s (%s)", __func__, path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+
+    ALOGI("%s: capturing display scenes to %s", __func__, path.c_str());
+    return true;
+}
+
+void DisplaySceneTrace::close() {
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+void DisplaySceneTrace::append(RecordType type, DisplayType display, const DisplayScene &scene,
+                               const std::vector<LayerMapping> &layerMapping) {
+    if (mFd < 0) return;
+
+    mBuffer.clear();
+    serialize(Record{type, systemTime(SYSTEM_TIME_MONOTONIC), display, scene, layerMapping},
+              mBuffer);
+
+    /* one write per record keeps a truncated trace readable up to the last record */
+    if (!android::base::WriteFully(mFd, mBuffer.data(), mBuffer.size())) {
+        ALOGE("%s: stop capture (%s)", __func__, strerror(errno));
+        close();
+    }
+}
+
+void DisplaySceneTrace::serialize(const Record &record, std::vector<uint8_t> &out) {
+    const size_t headerOffset = out.size();
+    out.resize(headerOffset + sizeof(RecordHeader));
+
+    TraceWriter writer(out);
+    const DisplayScene &scene = record.scene;
+    if (record.type == SCENE_UPDATE) {
+        writer.put(scene.dpu_bit_depth);
+        writer.put(scene.color_mode);
+        writer.put(scene.render_intent);
+        writer.put(scene.matrix);
+        writer.put(scene.force_hdr);
+        writer.put(scene.bm);
+        writer.put(scene.hdr_layer_state);
+        writer.put(static_cast<uint32_t>(scene.layer_data.size()));
+        for (const auto &layer : scene.layer_data) putLayerColorData(writer, layer);
+        writer.putVector(record.layerMapping);
+    }
+    writer.put(scene.refresh_rate);
+    writer.put(scene.lhbm_on);
+    writer.put(scene.dbv);
+
+    RecordHeader header = {};
+    header.type = record.type;
+    header.size = out.size() - headerOffset - sizeof(RecordHeader);
+    header.timestamp = record.timestamp;
+    header.display = static_cast<uint32_t>(record.display);
+    memcpy(out.data() + headerOffset, &header, sizeof(header));
+}
+
+bool DisplaySceneTrace::readFileHeader(const uint8_t *&cursor, const uint8_t *end) {
+    FileHeader header;
+    TraceReader reader(cursor, end);
+    if (!reader.get(header) || (header.magic != kMagic) || (header.version != kFileVersion))
+        return false;
+
+    if ((header.intfMajor != kInterfaceVersion.major) ||
+        (header.intfMinor != kInterfaceVersion.minor)) {
+        ALOGE("%s: trace from displaycolor %u.%u, expected %u.%u", __func__, header.intfMajor,
+              header.intfMinor, kInterfaceVersion.major, kInterfaceVersion.minor);
+        return false;
+    }
+
+    cursor = reader.cursor();
+    return true;
+}
+
+bool DisplaySceneTrace::deserialize(const uint8_t *&cursor, const uint8_t *end,
+                                    Record &record) {
+    RecordHeader header;
+    TraceReader headerReader(cursor, end);
+    if (!headerReader.get(header)) return false;
+
+    const uint8_t *payload = headerReader.cursor();
+    if (static_cast<size_t>(end - payload) < header.size) return false;
+
+    TraceReader reader(payload, payload + header.size);
+    DisplayScene &scene = record.scene;
+    if (header.type == SCENE_UPDATE) {
+        uint32_t layerCount;
+        if (!reader.get(scene.dpu_bit_depth) || !reader.get(scene.color_mode) ||
+            !reader.get(scene.render_intent) || !reader.get(scene.matrix) ||
+            !reader.get(scene.force_hdr) || !reader.get(scene.bm) ||
+            !reader.get(scene.hdr_layer_state) || !reader.get(layerCount))
+            return false;
+
+        scene.layer_data.resize(layerCount);
+        for (auto &layer : scene.layer_data) {
+            if (!getLayerColorData(reader, layer)) return false;
+        }
+        if (!reader.getVector(record.layerMapping)) return false;
+    } else if (header.type != SCENE_PRESENT) {
+        ALOGE("%s: unknown record type %u", __func__, header.type);
+        return false;
+    }
+
+    if (!reader.get(scene.refresh_rate) || !reader.get(scene.lhbm_on) || !reader.get(scene.dbv))
+        return false;
+
+    record.type = static_cast<RecordType>(header.type);
+    record.timestamp = header.timestamp;
+    record.display = static_cast<DisplayType>(header.display);
+    cursor = payload + header.size;
+    return true;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DISPLAY_SCENE_TRACE_H
+#define DISPLAY_SCENE_TRACE_H
+
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <utils/Timers.h>
+
+#include <string>
+#include <vector>
+
+/* capture every DisplayScene handed to displaycolor into kDisplaySceneTracePath */
+constexpr char kDisplaySceneCaptureProp[] = "vendor.display.color.scene_capture";
+constexpr char kDisplaySceneTracePath[] = "/data/vendor/display/scene_trace_%u.bin";
+
+namespace gs101 {
+
+/*
+ * Compact binary trace of the DisplayScenes passed to IDisplayColorGS101.
+ *
+ * File layout:
+ *   FileHeader
+ *   { RecordHeader, payload } * N
+ *
+ * SCENE_UPDATE records carry the whole DisplayScene and the layer mapping used
+ * for Update(). SCENE_PRESENT records only carry the fields refreshed before
+ * UpdatePresent() (refresh rate, lhbm and dbv).
+ */
+class DisplaySceneTrace {
+    public:
+        enum RecordType : uint32_t {
+            SCENE_UPDATE = 1,
+            SCENE_PRESENT = 2,
+        };
+        struct LayerMapping {
+            /* ExynosMPPSource address, only meaningful as an identity within a trace */
+            uint64_t layer;
+            uint32_t dppIdx;
+            uint32_t planeId;
+        };
+        struct Record {
+            RecordType type;
+            nsecs_t timestamp;
+            displaycolor::DisplayType display;
+            displaycolor::DisplayScene scene;
+            std::vector<LayerMapping> layerMapping;
+        };
+
+        DisplaySceneTrace() = default;
+        ~DisplaySceneTrace();
+
+        bool open(const std::string &path);
+        bool isOpen() const { return mFd >= 0; }
+        void close();
+        void append(RecordType type, displaycolor::DisplayType display,
+                    const displaycolor::DisplayScene &scene,
+                    const std::vector<LayerMapping> &layerMapping);
+
+        static void serialize(const Record &record, std::vector<uint8_t> &out);
+        /*
+         * Decode the record at cursor and advance it. For SCENE_PRESENT records
+         * only the present fields of record.scene are updated, so replaying a
+         * trace in order with one Record reproduces the scene seen by displaycolor.
+         */
+        static bool deserialize(const uint8_t *&cursor, const uint8_t *end, Record &record);
+        /* Validate the file header at cursor and advance past it */
+        static bool readFileHeader(const uint8_t *&cursor, const uint8_t *end);
+
+    private:
+        static constexpr uint32_t kMagic = 0x53435444; // "DTCS"
+        static constexpr uint32_t kFileVersion = 1;
+
+        struct FileHeader {
+            uint32_t magic;
+            uint32_t version;
+            /* displaycolor interface the scene layout was built against */
+            uint32_t intfMajor;
+            uint32_t intfMinor;
+        };
+        struct RecordHeader {
+            uint32_t type;
+            uint32_t size;
+            int64_t timestamp;
+            uint32_t display;
+            uint32_t reserved;
+        };
+
+        int mFd = -1;
+        std::vector<uint8_t> mBuffer;
+};
+
+}  // namespace gs101
+
+#endif // DISPLAY_SCENE_TRACE_H
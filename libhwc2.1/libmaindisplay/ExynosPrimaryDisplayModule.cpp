@@ -17,9 +17,13 @@
 #include "ExynosPrimaryDisplayModule.h"
 
 #include <android-base/file.h>
+#include <cutils/properties.h>
+#include <fcntl.h>
 #include <json/reader.h>
 #include <json/value.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cmath>
 
 #include "BrightnessController.h"
@@ -53,9 +57,34 @@ ExynosPrimaryDisplayModule::ExynosPrimaryDisplayModule(uint32_t index, ExynosDev
 #ifdef FORCE_GPU_COMPOSITION
     exynosHWCControl.forceGpu = true;
 #endif
+
+    if (property_get_bool(kDisplaySceneCaptureProp, false)) {
+        mDisplaySceneTrace = std::make_unique<DisplaySceneTrace>();
+        if (!mDisplaySceneTrace->open(String8::format(kDisplaySceneTracePath, index).string()))
+            mDisplaySceneTrace.reset();
+    }
+    mDbvBucket = std::max(property_get_int32(kDbvBucketProp, 0), 0);
+    mReclaimColorBlobs = property_get_bool(kColorReclaimBlobsProp, false);
 }
 
 ExynosPrimaryDisplayModule::~ExynosPrimaryDisplayModule () {
+    waitDisplayColorUpdate();
+    if (mAtcAnimatorThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mAtcAnimatorMutex);
+            mAtcAnimatorExit = true;
+        }
+        mAtcAnimatorCondition.notify_one();
+        mAtcAnimatorThread.join();
+    }
+    if (mAtcWriterThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mAtcWriterMutex);
+            mAtcWriterExit = true;
+        }
+        mAtcWriterCondition.notify_one();
+        mAtcWriterThread.join();
+    }
 }
 
 void ExynosPrimaryDisplayModule::usePreDefinedWindow(bool use)
@@ -120,14 +149,27 @@ void ExynosPrimaryDisplayModule::doPreProcessing() {
     }
 }
 
-int32_t ExynosPrimaryDisplayModule::getColorModes(
-        uint32_t* outNumModes, int32_t* outModes)
+const ColorModesMap &ExynosPrimaryDisplayModule::getColorModesMap()
 {
+    static const ColorModesMap kNoColorModes;
+    static const ColorModesMap kPassThroughColorModes = {
+        {hwc::ColorMode::NATIVE, {hwc::RenderIntent::COLORIMETRIC}},
+    };
+
+    /* checked first, the interface is published before loading is marked done */
+    const bool loading = isDisplayColorLoading();
     IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
+    if (displayColorInterface == nullptr)
+        return loading ? kPassThroughColorModes : kNoColorModes;
+
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    const ColorModesMap colorModeMap = displayColorInterface == nullptr
-            ? ColorModesMap()
-            : displayColorInterface->ColorModesAndRenderIntents(display);
+    return displayColorInterface->ColorModesAndRenderIntents(display);
+}
+
+int32_t ExynosPrimaryDisplayModule::getColorModes(
+        uint32_t* outNumModes, int32_t* outModes)
+{
+    const ColorModesMap &colorModeMap = getColorModesMap();
     ALOGD("%s: size(%zu)", __func__, colorModeMap.size());
     if (outModes == nullptr) {
         *outNumModes = colorModeMap.size();
@@ -153,11 +195,7 @@ int32_t ExynosPrimaryDisplayModule::getColorModes(
 int32_t ExynosPrimaryDisplayModule::setColorMode(int32_t mode)
 {
     ALOGD("%s: mode(%d)", __func__, mode);
-    IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
-    const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    const ColorModesMap colorModeMap = displayColorInterface == nullptr
-            ? ColorModesMap()
-            : displayColorInterface->ColorModesAndRenderIntents(display);
+    const ColorModesMap &colorModeMap = getColorModesMap();
     hwc::ColorMode colorMode =
         static_cast<hwc::ColorMode>(mode);
     const auto it = colorModeMap.find(colorMode);
@@ -177,11 +215,7 @@ int32_t ExynosPrimaryDisplayModule::setColorMode(int32_t mode)
 int32_t ExynosPrimaryDisplayModule::getRenderIntents(int32_t mode,
         uint32_t* outNumIntents, int32_t* outIntents)
 {
-    IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
-    const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    const ColorModesMap colorModeMap = displayColorInterface == nullptr
-            ? ColorModesMap()
-            : displayColorInterface->ColorModesAndRenderIntents(display);
+    const ColorModesMap &colorModeMap = getColorModesMap();
     ALOGD("%s, size(%zu)", __func__, colorModeMap.size());
     hwc::ColorMode colorMode =
         static_cast<hwc::ColorMode>(mode);
@@ -214,11 +248,7 @@ int32_t ExynosPrimaryDisplayModule::getRenderIntents(int32_t mode,
 int32_t ExynosPrimaryDisplayModule::setColorModeWithRenderIntent(int32_t mode,
         int32_t intent)
 {
-    IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
-    const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    const ColorModesMap colorModeMap = displayColorInterface == nullptr
-            ? ColorModesMap()
-            : displayColorInterface->ColorModesAndRenderIntents(display);
+    const ColorModesMap &colorModeMap = getColorModesMap();
     hwc::ColorMode colorMode =
         static_cast<hwc::ColorMode>(mode);
     hwc::RenderIntent renderIntent =
@@ -267,6 +297,25 @@ int32_t ExynosPrimaryDisplayModule::setColorTransform(
 
 }
 
+ExynosPrimaryDisplayModule::ColorTransformClass ExynosPrimaryDisplayModule::classifyColorTransform(
+        const std::array<float, TRANSFORM_MAT_SIZE> &matrix)
+{
+    if (matrix == kIdentityColorTransform)
+        return ColorTransformClass::IDENTITY;
+
+    /* last column must be (0, 0, 0, 1) for the offsets to be a plain translation */
+    if (matrix[3] != 0.0 || matrix[7] != 0.0 || matrix[11] != 0.0 || matrix[15] != 1.0)
+        return ColorTransformClass::GENERAL;
+
+    const bool diagonal = matrix[1] == 0.0 && matrix[2] == 0.0 && matrix[4] == 0.0 &&
+            matrix[6] == 0.0 && matrix[8] == 0.0 && matrix[9] == 0.0;
+    const bool noOffset = matrix[12] == 0.0 && matrix[13] == 0.0 && matrix[14] == 0.0;
+    if (diagonal && noOffset && matrix[0] == matrix[5] && matrix[0] == matrix[10])
+        return ColorTransformClass::UNIFORM_SCALE;
+
+    return ColorTransformClass::AFFINE;
+}
+
 int32_t ExynosPrimaryDisplayModule::getClientTargetProperty(
         hwc_client_target_property_t* outClientTargetProperty,
         HwcDimmingStage *outDimmingStage) {
@@ -365,6 +414,7 @@ bool ExynosPrimaryDisplayModule::hasDppForLayer(ExynosMPPSource* layer)
     if (displayColorInterface == nullptr) {
         return false;
     }
+    waitDisplayColorUpdate();
 
     if (mDisplaySceneInfo.layerDataMappingInfo.count(layer) == 0)
         return false;
@@ -385,6 +435,7 @@ const IDisplayColorGS101::IDpp& ExynosPrimaryDisplayModule::getDppForLayer(Exyno
     uint32_t index = mDisplaySceneInfo.layerDataMappingInfo[layer].dppIdx;
     IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
+    waitDisplayColorUpdate();
     return displayColorInterface->GetPipelineData(display)->Dpp()[index].get();
 }
 
@@ -410,21 +461,32 @@ int ExynosPrimaryDisplayModule::deliverWinConfigData()
 
     setForceColorUpdate(false);
 
-    if (displayColorInterface != nullptr) {
+    /* nothing is gained by reprogramming DQE and histogram while dozing */
+    moduleDisplayInterface->setColorUpdateSuspended(
+            (mPowerModeState == HWC2_POWER_MODE_DOZE) ||
+            (mPowerModeState == HWC2_POWER_MODE_DOZE_SUSPEND));
+
+    if (displayColorInterface != nullptr && mDisplayColorReady) {
+        const uint64_t bootHash = mDisplaySceneInfo.getDqeBootSceneHash();
+        moduleDisplayInterface->setDqeSceneHash(mDisplaySceneInfo.getDqeSceneHash(bootHash),
+                                                bootHash);
         moduleDisplayInterface->setColorSettingChanged(
             mDisplaySceneInfo.needDisplayColorSetting(),
             forceDisplayColorSetting);
+        moduleDisplayInterface->beginPlaneColorFrame();
+        moduleDisplayInterface->preparePlaneColorBlobs();
     }
 
     ret = ExynosDisplay::deliverWinConfigData();
 
-    checkAtcAnimation();
-
+    /*
+     * A readback frame not requested by the service may not leave its DQE
+     * settings applied; push again only what that frame delivered.
+     */
     if (mDpuData.enable_readback &&
        !mDpuData.readback_info.requested_from_service)
-        mDisplaySceneInfo.displaySettingDelivered = false;
-    else
-        mDisplaySceneInfo.displaySettingDelivered = true;
+        moduleDisplayInterface->requestDqeRepush();
+    mDisplaySceneInfo.displaySettingDelivered = true;
 
     return ret;
 }
@@ -450,7 +512,7 @@ int32_t ExynosPrimaryDisplayModule::DisplaySceneInfo::setLayerDataMappingInfo(
     }
     // if assigned displaycolor dppIdx changes, do not reuse it (force plane color update).
     uint32_t oldPlaneId = prev_layerDataMappingInfo.count(layer) != 0 &&
-                    prev_layerDataMappingInfo[layer].dppIdx != index
+                    prev_layerDataMappingInfo[layer].dppIdx == index
             ? prev_layerDataMappingInfo[layer].planeId
             : UINT_MAX;
     layerDataMappingInfo.insert(std::make_pair(layer, LayerMappingInfo{ index, oldPlaneId }));
@@ -515,7 +577,7 @@ void ExynosPrimaryDisplayModule::DisplaySceneInfo::setLayerHdrStaticMetadata(
 
 void ExynosPrimaryDisplayModule::DisplaySceneInfo::setLayerColorTransform(
         LayerColorData& layerColorData,
-        std::array<float, TRANSFORM_MAT_SIZE> &matrix)
+        const std::array<float, TRANSFORM_MAT_SIZE> &matrix)
 {
     updateInfoSingleVal(layerColorData.matrix, matrix);
 }
@@ -578,23 +640,9 @@ int32_t ExynosPrimaryDisplayModule::DisplaySceneInfo::setClientCompositionColorD
     disableLayerHdrStaticMetadata(layerData);
     disableLayerHdrDynamicMetadata(layerData);
 
-    if (dimSdrRatio != 1.0) {
-        std::array<float, TRANSFORM_MAT_SIZE> scaleMatrix = {
-            dimSdrRatio, 0.0, 0.0, 0.0,
-            0.0, dimSdrRatio, 0.0, 0.0,
-            0.0, 0.0, dimSdrRatio, 0.0,
-            0.0, 0.0, 0.0, 1.0
-        };
-        setLayerColorTransform(layerData, scaleMatrix);
-    } else {
-        static std::array<float, TRANSFORM_MAT_SIZE> defaultMatrix {
-            1.0, 0.0, 0.0, 0.0,
-            0.0, 1.0, 0.0, 0.0,
-            0.0, 0.0, 1.0, 0.0,
-            0.0, 0.0, 0.0, 1.0
-        };
-        setLayerColorTransform(layerData, defaultMatrix);
-    }
+    /* identity when dimSdrRatio is 1 */
+    setDimSdrRatio(dimSdrRatio);
+    setLayerColorTransform(layerData, dimScaleMatrix);
 
     return NO_ERROR;
 }
@@ -620,52 +668,36 @@ int32_t ExynosPrimaryDisplayModule::DisplaySceneInfo::setLayerColorData(
         disableLayerHdrDynamicMetadata(layerData);
     }
 
-    static std::array<float, TRANSFORM_MAT_SIZE> defaultMatrix {
-        1.0, 0.0, 0.0, 0.0,
-        0.0, 1.0, 0.0, 0.0,
-        0.0, 0.0, 1.0, 0.0,
-        0.0, 0.0, 0.0, 1.0
-    };
-
+    const bool hasTransform = layer->mLayerColorTransform.enable;
     if (dimSdrRatio == 1.0 || layer->mIsHdrLayer) {
-        if (layer->mLayerColorTransform.enable)
-            setLayerColorTransform(layerData,
-                    layer->mLayerColorTransform.mat);
-        else
-            setLayerColorTransform(layerData,
-                    defaultMatrix);
+        setLayerColorTransform(layerData,
+                hasTransform ? layer->mLayerColorTransform.mat : kIdentityColorTransform);
+    } else if (!hasTransform || (classifyColorTransform(layer->mLayerColorTransform.mat) ==
+                                 ColorTransformClass::IDENTITY)) {
+        /* fold the dim ratio with the scale matrix shared by all layers of the frame */
+        setDimSdrRatio(dimSdrRatio);
+        setLayerColorTransform(layerData, dimScaleMatrix);
     } else {
-        if (layer->mLayerColorTransform.enable) {
-            std::array<float, TRANSFORM_MAT_SIZE> scaleMatrix =
-                layer->mLayerColorTransform.mat;
-
-            // scale coeffs
-            scaleMatrix[0] *= dimSdrRatio;
-            scaleMatrix[1] *= dimSdrRatio;
-            scaleMatrix[2] *= dimSdrRatio;
-            scaleMatrix[4] *= dimSdrRatio;
-            scaleMatrix[5] *= dimSdrRatio;
-            scaleMatrix[6] *= dimSdrRatio;
-            scaleMatrix[8] *= dimSdrRatio;
-            scaleMatrix[9] *= dimSdrRatio;
-            scaleMatrix[10] *= dimSdrRatio;
-
-            // scale offsets
-            scaleMatrix[12] *= dimSdrRatio;
-            scaleMatrix[13] *= dimSdrRatio;
-            scaleMatrix[14] *= dimSdrRatio;
-
-            setLayerColorTransform(layerData, scaleMatrix);
-        } else {
-            std::array<float, TRANSFORM_MAT_SIZE> scaleMatrix = {
-                dimSdrRatio, 0.0, 0.0, 0.0,
-                0.0, dimSdrRatio, 0.0, 0.0,
-                0.0, 0.0, dimSdrRatio, 0.0,
-                0.0, 0.0, 0.0, 1.0
-            };
-
-            setLayerColorTransform(layerData, scaleMatrix);
-        }
+        std::array<float, TRANSFORM_MAT_SIZE> scaleMatrix =
+            layer->mLayerColorTransform.mat;
+
+        // scale coeffs
+        scaleMatrix[0] *= dimSdrRatio;
+        scaleMatrix[1] *= dimSdrRatio;
+        scaleMatrix[2] *= dimSdrRatio;
+        scaleMatrix[4] *= dimSdrRatio;
+        scaleMatrix[5] *= dimSdrRatio;
+        scaleMatrix[6] *= dimSdrRatio;
+        scaleMatrix[8] *= dimSdrRatio;
+        scaleMatrix[9] *= dimSdrRatio;
+        scaleMatrix[10] *= dimSdrRatio;
+
+        // scale offsets
+        scaleMatrix[12] *= dimSdrRatio;
+        scaleMatrix[13] *= dimSdrRatio;
+        scaleMatrix[14] *= dimSdrRatio;
+
+        setLayerColorTransform(layerData, scaleMatrix);
     }
 
     return NO_ERROR;
@@ -679,6 +711,18 @@ int32_t ExynosPrimaryDisplayModule::updateColorConversionInfo()
         return ret;
     }
 
+    /* displaycolor became available, replace the pass-through color state once */
+    if (!mDisplayColorReady) {
+        mDisplayColorReady = true;
+        setForceColorUpdate(true);
+    }
+
+    /* displaycolor must not update the IDqe data a worker may still be reading */
+    static_cast<ExynosDisplayDrmInterfaceModule*>(mDisplayInterface.get())
+            ->waitDisplayColorBlobs();
+    /* nor may the scene be rebuilt while the last Update() still reads it */
+    waitDisplayColorUpdate();
+
     /* clear flag and layer mapping info before setting */
     mDisplaySceneInfo.reset();
 
@@ -692,28 +736,71 @@ int32_t ExynosPrimaryDisplayModule::updateColorConversionInfo()
     mDisplaySceneInfo.displayScene.force_hdr = mBrightnessController->isDimSdr();
     mDisplaySceneInfo.displayScene.lhbm_on = mBrightnessController->isLhbmOn();
     mDisplaySceneInfo.displayScene.hdr_layer_state = mBrightnessController->getHdrLayerState();
-    mDisplaySceneInfo.displayScene.dbv = mBrightnessController->getBrightnessLevel();
+    mDisplaySceneInfo.displayScene.dbv = getSceneDbv(mBrightnessController->getBrightnessLevel());
+
+    const bool colorDebug = hwcCheckDebugMessages(eDebugColorManagement);
+    if (colorDebug)
+        mDisplaySceneInfo.recordDisplayScene(mIndex);
+
+    traceDisplayScene(DisplaySceneTrace::SCENE_UPDATE);
+
+    /* the new scene has to be followed by UpdatePresent() */
+    mPresentInputsValid = false;
+
+    /*
+     * Update() is the costly displaycolor call of a frame, UpdatePresent()
+     * only refreshes the present-time inputs. With both built-in displays on,
+     * Update() runs on the color worker pool from validate until the present
+     * of this display, overlapping the validate of the other display. The
+     * scene is not touched until updatePresentColorConversionInfo() joins it.
+     */
+    ExynosDeviceModule* device = (ExynosDeviceModule*)mDevice;
+    ColorWorkerPool* pool = device->getDisplayColorWorkerPool();
+    if (pool != nullptr) {
+        std::lock_guard<std::mutex> lock(mDisplayColorUpdateMutex);
+        mDisplayColorUpdate = pool->post([this, displayColorInterface]() {
+            return updateDisplayColor(displayColorInterface);
+        });
+        return NO_ERROR;
+    }
 
-    if (hwcCheckDebugMessages(eDebugColorManagement))
-        mDisplaySceneInfo.printDisplayScene();
+    return updateDisplayColor(displayColorInterface);
+}
 
+int32_t ExynosPrimaryDisplayModule::updateDisplayColor(IDisplayColorGS101* displayColorInterface)
+{
+    const bool colorDebug = hwcCheckDebugMessages(eDebugColorManagement);
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    if ((ret = displayColorInterface->Update(display, mDisplaySceneInfo.displayScene)) != 0) {
+    const nsecs_t start = colorDebug ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+    int32_t ret = displayColorInterface->Update(display, mDisplaySceneInfo.displayScene);
+    if (colorDebug)
+        ColorTrace::record(ColorTrace::DISPLAY_COLOR_UPDATE, mIndex, 0, 0,
+                ColorTrace::DisplayColorUpdate{ret, 0,
+                                               systemTime(SYSTEM_TIME_MONOTONIC) - start});
+    if (ret != 0)
         DISPLAY_LOGE("Display Scene update error (%d)", ret);
-        return ret;
-    }
 
     return ret;
 }
 
+int32_t ExynosPrimaryDisplayModule::waitDisplayColorUpdate()
+{
+    std::lock_guard<std::mutex> lock(mDisplayColorUpdateMutex);
+    return mDisplayColorUpdate.valid() ? mDisplayColorUpdate.get() : NO_ERROR;
+}
+
 int32_t ExynosPrimaryDisplayModule::updatePresentColorConversionInfo()
 {
     int ret = NO_ERROR;
     IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
-    if (displayColorInterface == nullptr) {
+    /* displaycolor is switched on by updateColorConversionInfo(), not here */
+    if ((displayColorInterface == nullptr) || !mDisplayColorReady) {
         return ret;
     }
 
+    if ((ret = waitDisplayColorUpdate()) != NO_ERROR)
+        return ret;
+
     ExynosDisplayDrmInterfaceModule *moduleDisplayInterface =
         (ExynosDisplayDrmInterfaceModule*)(mDisplayInterface.get());
     auto refresh_rate = moduleDisplayInterface->getDesiredRefreshRate();
@@ -722,23 +809,98 @@ int32_t ExynosPrimaryDisplayModule::updatePresentColorConversionInfo()
     }
 
     mDisplaySceneInfo.displayScene.lhbm_on = mBrightnessController->isLhbmOn();
-    mDisplaySceneInfo.displayScene.dbv = mBrightnessController->getBrightnessLevel();
+    mDisplaySceneInfo.displayScene.dbv = getPresentDbv();
+
+    const present_inputs inputs = {mDisplaySceneInfo.displayScene.refresh_rate,
+                                   mDisplaySceneInfo.displayScene.lhbm_on,
+                                   mDisplaySceneInfo.displayScene.dbv};
+    if (mPresentInputsValid && inputs == mPresentInputs) {
+        mUpdatePresentSkips++;
+        moduleDisplayInterface->prepareDisplayColorBlobsAsync();
+        return NO_ERROR;
+    }
+
+    traceDisplayScene(DisplaySceneTrace::SCENE_PRESENT);
+
+    const bool colorDebug = hwcCheckDebugMessages(eDebugColorManagement);
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
-    if ((ret = displayColorInterface->UpdatePresent(display, mDisplaySceneInfo.displayScene)) !=
-        0) {
+    const nsecs_t start = colorDebug ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+    ret = displayColorInterface->UpdatePresent(display, mDisplaySceneInfo.displayScene);
+    mUpdatePresentCalls++;
+    if (colorDebug)
+        ColorTrace::record(ColorTrace::DISPLAY_COLOR_UPDATE_PRESENT, mIndex, 0, 0,
+                ColorTrace::DisplayColorUpdate{ret, 0,
+                                               systemTime(SYSTEM_TIME_MONOTONIC) - start});
+    if (ret != 0) {
         DISPLAY_LOGE("Display Scene update error (%d)", ret);
         return ret;
     }
+    mPresentInputs = inputs;
+    mPresentInputsValid = true;
+    moduleDisplayInterface->prepareDisplayColorBlobsAsync();
 
     return ret;
 }
 
+uint32_t ExynosPrimaryDisplayModule::getSceneDbv(uint32_t level)
+{
+    const uint32_t sceneDbv = mDisplaySceneInfo.displayScene.dbv;
+    const bool ramping = (level != mLastBrightnessLevel);
+
+    /* the exact level is submitted as soon as the ramp settles */
+    if (mDbvBucket == 0 || !ramping || (level / mDbvBucket != sceneDbv / mDbvBucket))
+        return level;
+
+    return sceneDbv;
+}
+
+uint32_t ExynosPrimaryDisplayModule::getPresentDbv()
+{
+    const uint32_t level = mBrightnessController->getBrightnessLevel();
+    const uint32_t dbv = getSceneDbv(level);
+    mLastBrightnessLevel = level;
+
+    if (dbv != level) {
+        mDbvCoalesced++;
+        /*
+         * This may be the last step of the ramp on a static screen, refresh
+         * once more so the settled level reaches displaycolor.
+         */
+        mDevice->onRefresh();
+    } else if (dbv != mPresentInputs.dbv) {
+        mDbvChanges++;
+    }
+
+    return dbv;
+}
+
+void ExynosPrimaryDisplayModule::traceDisplayScene(DisplaySceneTrace::RecordType type)
+{
+    if (mDisplaySceneTrace == nullptr)
+        return;
+
+    std::vector<DisplaySceneTrace::LayerMapping> layerMapping;
+    if (type == DisplaySceneTrace::SCENE_UPDATE) {
+        layerMapping.reserve(mDisplaySceneInfo.layerDataMappingInfo.size());
+        for (auto &it : mDisplaySceneInfo.layerDataMappingInfo) {
+            layerMapping.push_back({reinterpret_cast<uintptr_t>(it.first),
+                                    it.second.dppIdx, it.second.planeId});
+        }
+    }
+
+    mDisplaySceneTrace->append(type, getDisplayTypeFromIndex(mIndex),
+                               mDisplaySceneInfo.displayScene, layerMapping);
+    if (!mDisplaySceneTrace->isOpen())
+        mDisplaySceneTrace.reset();
+}
+
 int32_t ExynosPrimaryDisplayModule::getColorAdjustedDbv(uint32_t &dbv_adj) {
     IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
     if (displayColorInterface == nullptr) {
         return NO_ERROR;
     }
 
+    waitDisplayColorUpdate();
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
     dbv_adj = displayColorInterface->GetPipelineData(display)->Panel().GetAdjustedBrightnessLevel();
     return NO_ERROR;
@@ -758,68 +920,99 @@ bool ExynosPrimaryDisplayModule::DisplaySceneInfo::needDisplayColorSetting()
     return false;
 }
 
-void ExynosPrimaryDisplayModule::DisplaySceneInfo::printDisplayScene()
+uint64_t ExynosPrimaryDisplayModule::DisplaySceneInfo::getDqeBootSceneHash() const
+{
+    /*
+     * refresh_rate, dbv and lhbm_on change from boot to boot and would keep the
+     * DQE table cache from ever hitting. Tables served for another brightness
+     * are replaced by the delivery that follows them.
+     */
+    uint64_t hash = DqeTableCache::checksum(&displayScene.dpu_bit_depth,
+                                            sizeof(displayScene.dpu_bit_depth));
+    const auto add = [&hash](const auto &field) {
+        hash = DqeTableCache::checksum(&field, sizeof(field), hash);
+    };
+    add(displayScene.color_mode);
+    add(displayScene.render_intent);
+    add(displayScene.matrix);
+    add(displayScene.force_hdr);
+    add(displayScene.bm);
+    add(displayScene.hdr_layer_state);
+
+    return hash;
+}
+
+uint64_t ExynosPrimaryDisplayModule::DisplaySceneInfo::getDqeSceneHash(uint64_t bootHash) const
+{
+    uint64_t hash = bootHash;
+    const auto add = [&hash](const auto &field) {
+        hash = DqeTableCache::checksum(&field, sizeof(field), hash);
+    };
+    add(displayScene.refresh_rate);
+    add(displayScene.lhbm_on);
+    add(displayScene.dbv);
+
+    return hash;
+}
+
+void ExynosPrimaryDisplayModule::DisplaySceneInfo::recordDisplayScene(uint32_t display)
 {
-    ALOGD("======================= DisplayScene info ========================");
-    ALOGD("dpu_bit_depth: %d", static_cast<uint32_t>(displayScene.dpu_bit_depth));
-    ALOGD("color_mode: %d", static_cast<uint32_t>(displayScene.color_mode));
-    ALOGD("render_intent: %d", static_cast<uint32_t>(displayScene.render_intent));
-    ALOGD("matrix");
-    for (uint32_t i = 0; i < 16; (i += 4)) {
-        ALOGD("%f, %f, %f, %f",
-                displayScene.matrix[i], displayScene.matrix[i+1],
-                displayScene.matrix[i+2], displayScene.matrix[i+3]);
-    }
-    ALOGD("layer: %zu ++++++",
-            displayScene.layer_data.size());
+    ColorTrace::record(ColorTrace::SCENE, display, 0, 0,
+            ColorTrace::Scene{static_cast<uint32_t>(displayScene.dpu_bit_depth),
+                              static_cast<uint32_t>(displayScene.color_mode),
+                              static_cast<uint32_t>(displayScene.render_intent)});
+
+    ColorTrace::Matrix matrix;
+    std::copy(displayScene.matrix.begin(), displayScene.matrix.end(), matrix.value);
+    ColorTrace::record(ColorTrace::SCENE_MATRIX, display, 0,
+            displayScene.layer_data.size(), matrix);
+
     for (uint32_t i = 0; i < displayScene.layer_data.size(); i++) {
-        ALOGD("layer[%d] info", i);
-        printLayerColorData(displayScene.layer_data[i]);
+        recordLayerColorData(display, i, displayScene.layer_data[i]);
     }
 
-    ALOGD("layerDataMappingInfo: %zu ++++++",
-            layerDataMappingInfo.size());
+    uint16_t index = 0;
     for (auto layer : layerDataMappingInfo) {
-        ALOGD("[layer: %p] [%d, %d]", layer.first, layer.second.dppIdx, layer.second.planeId);
+        ColorTrace::record(ColorTrace::LAYER_MAPPING, display, index++,
+                layerDataMappingInfo.size(),
+                ColorTrace::LayerMapping{reinterpret_cast<uintptr_t>(layer.first),
+                                         layer.second.dppIdx, layer.second.planeId});
     }
 }
 
-void ExynosPrimaryDisplayModule::DisplaySceneInfo::printLayerColorData(
-    const LayerColorData& layerData)
+void ExynosPrimaryDisplayModule::DisplaySceneInfo::recordLayerColorData(
+    uint32_t display, uint16_t index, const LayerColorData& layerData)
 {
-    ALOGD("dataspace: 0x%8x", static_cast<uint32_t>(layerData.dataspace));
-    ALOGD("matrix");
-    for (uint32_t i = 0; i < 16; (i += 4)) {
-        ALOGD("%f, %f, %f, %f",
-                layerData.matrix[i], layerData.matrix[i+1],
-                layerData.matrix[i+2], layerData.matrix[i+3]);
-    }
-    ALOGD("static_metadata.is_valid(%d)", layerData.static_metadata.is_valid);
-    if (layerData.static_metadata.is_valid) {
-        ALOGD("\tdisplay_red_primary(%d, %d)",
-                layerData.static_metadata.display_red_primary_x,
-                layerData.static_metadata.display_red_primary_y);
-        ALOGD("\tdisplay_green_primary(%d, %d)",
-                layerData.static_metadata.display_green_primary_x,
-                layerData.static_metadata.display_green_primary_y);
-        ALOGD("\tdisplay_blue_primary(%d, %d)",
-                layerData.static_metadata.display_blue_primary_x,
-                layerData.static_metadata.display_blue_primary_y);
-        ALOGD("\twhite_point(%d, %d)",
-                layerData.static_metadata.white_point_x,
-                layerData.static_metadata.white_point_y);
-    }
-    ALOGD("dynamic_metadata.is_valid(%d)", layerData.dynamic_metadata.is_valid);
-    if (layerData.dynamic_metadata.is_valid) {
-        ALOGD("\tdisplay_maximum_luminance: %d",
-                layerData.dynamic_metadata.display_maximum_luminance);
-        ALOGD("\tmaxscl(%d, %d, %d)", layerData.dynamic_metadata.maxscl[0],
-                layerData.dynamic_metadata.maxscl[1],
-                layerData.dynamic_metadata.maxscl[2]);
-        ALOGD("\ttm_flag(%d)", layerData.dynamic_metadata.tm_flag);
-        ALOGD("\ttm_knee_x(%d)", layerData.dynamic_metadata.tm_knee_x);
-        ALOGD("\ttm_knee_y(%d)", layerData.dynamic_metadata.tm_knee_y);
-    }
+    ColorTrace::record(ColorTrace::LAYER, display, index, 0,
+            ColorTrace::Layer{static_cast<uint32_t>(layerData.dataspace)});
+
+    ColorTrace::Matrix matrix;
+    std::copy(layerData.matrix.begin(), layerData.matrix.end(), matrix.value);
+    ColorTrace::record(ColorTrace::LAYER_MATRIX, display, index, 0, matrix);
+
+    const auto &st = layerData.static_metadata;
+    ColorTrace::record(ColorTrace::LAYER_STATIC_METADATA, display, index, 0,
+            ColorTrace::LayerStaticMetadata{
+                    st.is_valid,
+                    {static_cast<uint32_t>(st.display_red_primary_x),
+                     static_cast<uint32_t>(st.display_red_primary_y)},
+                    {static_cast<uint32_t>(st.display_green_primary_x),
+                     static_cast<uint32_t>(st.display_green_primary_y)},
+                    {static_cast<uint32_t>(st.display_blue_primary_x),
+                     static_cast<uint32_t>(st.display_blue_primary_y)},
+                    {static_cast<uint32_t>(st.white_point_x),
+                     static_cast<uint32_t>(st.white_point_y)}});
+
+    const auto &dyn = layerData.dynamic_metadata;
+    ColorTrace::record(ColorTrace::LAYER_DYNAMIC_METADATA, display, index, 0,
+            ColorTrace::LayerDynamicMetadata{
+                    dyn.is_valid,
+                    static_cast<uint32_t>(dyn.display_maximum_luminance),
+                    {static_cast<uint32_t>(dyn.maxscl[0]), static_cast<uint32_t>(dyn.maxscl[1]),
+                     static_cast<uint32_t>(dyn.maxscl[2])},
+                    static_cast<uint32_t>(dyn.tm_flag),
+                    static_cast<uint32_t>(dyn.tm_knee_x),
+                    static_cast<uint32_t>(dyn.tm_knee_y)});
 }
 
 bool ExynosPrimaryDisplayModule::parseAtcProfile() {
@@ -841,24 +1034,39 @@ bool ExynosPrimaryDisplayModule::parseAtcProfile() {
 
     ALOGI("Atc Profile version = %s", root[kAtcProfileVersionStr].asString().c_str());
     Json::Value nodes = root[kAtcProfileModesStr];
-    atc_mode mode;
 
     for (Json::Value::ArrayIndex i = 0; i < nodes.size(); ++i) {
         std::string name = nodes[i][kAtcProfileModeNameStr].asString();
-
-        if (nodes[i][kAtcProfileLuxMapStr].size() != nodes[i][kAtcProfileAlMapStr].size() &&
-            nodes[i][kAtcProfileAlMapStr].size() != nodes[i][kAtcProfileStMapStr].size()) {
-            ALOGE("Atc profile is unavailable !");
+        uint32_t id = 0;
+        while (id < ATC_MODE_NUM && name != kAtcModeNames[id]) id++;
+        if (id == ATC_MODE_NUM) {
+            ALOGW("Atc mode %s is not supported, ignored", name.c_str());
+            continue;
+        }
+        atc_mode &mode = mAtcModeSetting[id];
+        if (mode.valid) {
+            ALOGE("Atc mode %s is already existed!", name.c_str());
             return false;
         }
 
         uint32_t map_cnt = nodes[i][kAtcProfileLuxMapStr].size();
+        if (map_cnt == 0 || map_cnt != nodes[i][kAtcProfileAlMapStr].size() ||
+            map_cnt != nodes[i][kAtcProfileStMapStr].size()) {
+            ALOGE("Atc profile is unavailable !");
+            return false;
+        }
 
-        mode.lux_map.clear();
+        mode.lux.resize(map_cnt);
+        mode.al.resize(map_cnt);
+        mode.st.resize(map_cnt);
         for (uint32_t index = 0; index < map_cnt; ++index) {
-            mode.lux_map.emplace_back(atc_lux_map{nodes[i][kAtcProfileLuxMapStr][index].asUInt(),
-                                                  nodes[i][kAtcProfileAlMapStr][index].asUInt(),
-                                                  nodes[i][kAtcProfileStMapStr][index].asUInt()});
+            mode.lux[index] = nodes[i][kAtcProfileLuxMapStr][index].asUInt();
+            mode.al[index] = nodes[i][kAtcProfileAlMapStr][index].asUInt();
+            mode.st[index] = nodes[i][kAtcProfileStMapStr][index].asUInt();
+        }
+        if (!std::is_sorted(mode.lux.begin(), mode.lux.end())) {
+            ALOGE("Atc mode %s lux map is not ascending", name.c_str());
+            return false;
         }
 
         if (!nodes[i][kAtcProfileStUpStepStr].empty())
@@ -871,20 +1079,25 @@ bool ExynosPrimaryDisplayModule::parseAtcProfile() {
         else
             mode.st_down_step = kAtcStStep;
 
-        if (nodes[i][kAtcProfileSubSettingStr].size() != kAtcSubSetting.size()) return false;
+        if (!nodes[i][kAtcProfileStStepIntervalStr].empty())
+            mode.st_step_interval_ms = nodes[i][kAtcProfileStStepIntervalStr].asUInt();
+        else
+            mode.st_step_interval_ms = kAtcStStepIntervalMs;
 
-        for (auto it = kAtcSubSetting.begin(); it != kAtcSubSetting.end(); it++) {
-            mode.sub_setting[it->first.c_str()] =
-                    nodes[i][kAtcProfileSubSettingStr][it->first.c_str()].asUInt();
-        }
-        auto ret = mAtcModeSetting.insert(std::make_pair(name.c_str(), mode));
-        if (ret.second == false) {
-            ALOGE("Atc mode %s is already existed!", ret.first->first.c_str());
-            return false;
+        mode.lux_hysteresis = nodes[i][kAtcProfileLuxHysteresisStr].asUInt();
+        mode.min_transition_interval =
+                ms2ns(nodes[i][kAtcProfileMinTransitionIntervalStr].asUInt());
+
+        if (nodes[i][kAtcProfileSubSettingStr].size() != kAtcSubSettingNum) return false;
+
+        for (size_t index = 0; index < kAtcSubSettingNum; index++) {
+            mode.sub_setting[index] =
+                    nodes[i][kAtcProfileSubSettingStr][kAtcSubSetting[index].name].asUInt();
         }
+        mode.valid = true;
     }
 
-    if (mAtcModeSetting.find(kAtcModeNormalStr) == mAtcModeSetting.end()) {
+    if (!mAtcModeSetting[ATC_MODE_NORMAL].valid) {
         ALOGW("Failed to find atc normal mode");
         return false;
     }
@@ -898,125 +1111,216 @@ void ExynosPrimaryDisplayModule::initLbe() {
         return;
     }
 
+    char root[PROPERTY_VALUE_MAX];
+    property_get(kAtcSysfsRootProp, root, kAtcSysfsRootDefault);
+
     mAtcInit = true;
-    mAtcAmbientLight.node = String8::format(ATC_AMBIENT_LIGHT_FILE_NAME, mIndex);
-    mAtcAmbientLight.value.set_dirty();
-    mAtcStrength.node = String8::format(ATC_ST_FILE_NAME, mIndex);
-    mAtcStrength.value.set_dirty();
-    mAtcEnable.node = String8::format(ATC_ENABLE_FILE_NAME, mIndex);
-    mAtcEnable.value.set_dirty();
+    initAtcSysfs(mAtcAmbientLight, root, ATC_AMBIENT_LIGHT_FILE_NAME);
+    initAtcSysfs(mAtcStrength, root, ATC_ST_FILE_NAME);
+    initAtcSysfs(mAtcEnable, root, ATC_ENABLE_FILE_NAME);
 
-    for (auto it = kAtcSubSetting.begin(); it != kAtcSubSetting.end(); it++) {
-        mAtcSubSetting[it->first.c_str()].node = String8::format(it->second.c_str(), mIndex);
-        mAtcSubSetting[it->first.c_str()].value.set_dirty();
+    for (size_t index = 0; index < kAtcSubSettingNum; index++) {
+        initAtcSysfs(mAtcSubSetting[index], root, kAtcSubSetting[index].node);
     }
+
+    if (!mAtcWriterThread.joinable())
+        mAtcWriterThread = std::thread(&ExynosPrimaryDisplayModule::atcWriterLoop, this);
+    if (!mAtcAnimatorThread.joinable())
+        mAtcAnimatorThread = std::thread(&ExynosPrimaryDisplayModule::atcAnimatorLoop, this);
 }
 
-uint32_t ExynosPrimaryDisplayModule::getAtcLuxMapIndex(std::vector<atc_lux_map> map, uint32_t lux) {
-    uint32_t index = 0;
-    for (uint32_t i = 0; i < map.size(); i++) {
-        if (lux < map[i].lux) {
-            break;
-        }
-        index = i;
+void ExynosPrimaryDisplayModule::initAtcSysfs(struct atc_sysfs &sysfs, const std::string &root,
+                                              const char *node) {
+    sysfs.node = String8::format("%s/", root.c_str());
+    sysfs.node.appendFormat(node, mIndex);
+    sysfs.value.set_dirty();
+    sysfs.fd.reset(::open(sysfs.node.string(), O_WRONLY | O_CLOEXEC));
+    if (sysfs.fd < 0)
+        ALOGW("%s: failed to open %s (%s)", __func__, sysfs.node.string(), strerror(errno));
+}
+
+int32_t ExynosPrimaryDisplayModule::writeAtcSysfs(struct atc_sysfs &sysfs, int32_t value) {
+    char buf[16];
+    const int len = snprintf(buf, sizeof(buf), "%d", value);
+
+    /* the node may have been recreated (e.g. driver rebind), reopen once and retry */
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (sysfs.fd < 0 || attempt > 0)
+            sysfs.fd.reset(::open(sysfs.node.string(), O_WRONLY | O_CLOEXEC));
+        if (sysfs.fd >= 0 && pwrite(sysfs.fd, buf, len, 0) == len)
+            return NO_ERROR;
     }
 
-    return index;
+    ALOGE("%s: failed to write %d to %s (%s)", __func__, value, sysfs.node.string(),
+          strerror(errno));
+    return -EPERM;
+}
+
+void ExynosPrimaryDisplayModule::queueAtcWriteLocked(struct atc_sysfs &sysfs, int32_t value) {
+    auto it = std::find_if(mAtcWriteQueue.begin(), mAtcWriteQueue.end(),
+                           [&sysfs](const auto &write) { return write.first == &sysfs; });
+    if (it != mAtcWriteQueue.end()) mAtcWriteQueue.erase(it);
+    mAtcWriteQueue.emplace_back(&sysfs, value);
 }
 
-int32_t ExynosPrimaryDisplayModule::setAtcStrength(uint32_t strength) {
-    mAtcStrength.value.store(strength);
-    if (mAtcStrength.value.is_dirty()) {
-        if (writeIntToFile(mAtcStrength.node, mAtcStrength.value.get()) != NO_ERROR) return -EPERM;
-        mAtcStrength.value.clear_dirty();
+void ExynosPrimaryDisplayModule::queueAtcWrite(struct atc_sysfs &sysfs, int32_t value) {
+    {
+        std::lock_guard<std::mutex> lock(mAtcWriterMutex);
+        queueAtcWriteLocked(sysfs, value);
     }
-    return NO_ERROR;
+    mAtcWriterCondition.notify_one();
+}
+
+void ExynosPrimaryDisplayModule::queueAtcStrengthWrite() {
+    {
+        /*
+         * Sample the strength under the queue lock, so concurrent updaters
+         * cannot queue their results out of order.
+         */
+        std::lock_guard<std::mutex> lock(mAtcWriterMutex);
+        queueAtcWriteLocked(mAtcStrength, mAtcStState.load(std::memory_order_acquire).strength);
+    }
+    mAtcWriterCondition.notify_one();
+}
+
+void ExynosPrimaryDisplayModule::atcWriterLoop() {
+    std::vector<std::pair<struct atc_sysfs*, int32_t>> writes;
+
+    std::unique_lock<std::mutex> lock(mAtcWriterMutex);
+    while (true) {
+        mAtcWriterCondition.wait(lock,
+                                 [this] { return mAtcWriterExit || !mAtcWriteQueue.empty(); });
+        if (mAtcWriteQueue.empty()) break;
+
+        writes.swap(mAtcWriteQueue);
+        lock.unlock();
+        for (auto &write : writes) writeAtcSysfs(*write.first, write.second);
+        writes.clear();
+        lock.lock();
+    }
+}
+
+uint32_t ExynosPrimaryDisplayModule::getAtcLuxMapIndex(const atc_mode &mode, uint32_t lux) {
+    /* last threshold not above lux, or the first one when lux is below all of them */
+    auto it = std::upper_bound(mode.lux.begin(), mode.lux.end(), lux);
+    return it == mode.lux.begin() ? 0 : std::distance(mode.lux.begin(), it) - 1;
+}
+
+uint32_t ExynosPrimaryDisplayModule::filterAtcLuxMapIndex(const atc_mode &mode, uint32_t lux) {
+    const uint32_t current = std::min<uint32_t>(mAtcLuxMapIndex, mode.lux.size() - 1);
+    uint32_t index = getAtcLuxMapIndex(mode, lux);
+    if (index == current) return current;
+
+    /* the threshold next to the current band has to be crossed by lux_hysteresis */
+    const uint32_t hysteresis = mode.lux_hysteresis;
+    if (index > current)
+        index = std::max(current, getAtcLuxMapIndex(mode, lux > hysteresis ? lux - hysteresis : 0));
+    else
+        index = std::min(current, getAtcLuxMapIndex(mode, lux + hysteresis));
+    if (index == current) {
+        mAtcHysteresisSuppressed++;
+        return current;
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now - mAtcLuxMapIndexTime < mode.min_transition_interval) {
+        mAtcRateLimitSuppressed++;
+        /* no new lux may come, re-apply it once the interval has expired */
+        scheduleAtcLuxRecheck(mAtcLuxMapIndexTime + mode.min_transition_interval);
+        return current;
+    }
+
+    mAtcLuxMapIndexTime = now;
+    return index;
 }
 
 int32_t ExynosPrimaryDisplayModule::setAtcAmbientLight(uint32_t ambient_light) {
     mAtcAmbientLight.value.store(ambient_light);
     if (mAtcAmbientLight.value.is_dirty()) {
-        if (writeIntToFile(mAtcAmbientLight.node, mAtcAmbientLight.value.get()) != NO_ERROR)
-            return -EPERM;
+        queueAtcWrite(mAtcAmbientLight, mAtcAmbientLight.value.get());
         mAtcAmbientLight.value.clear_dirty();
     }
 
     return NO_ERROR;
 }
 
-int32_t ExynosPrimaryDisplayModule::setAtcMode(std::string mode_name) {
-    auto mode_data = mAtcModeSetting.find(mode_name);
+int32_t ExynosPrimaryDisplayModule::setAtcMode(atc_mode_id mode_id) {
     uint32_t ambient_light = 0;
     uint32_t strength = 0;
-    bool enable = (!mode_name.empty()) && (mode_data != mAtcModeSetting.end());
+    bool enable = (mode_id < ATC_MODE_NUM) && mAtcModeSetting[mode_id].valid;
 
     if (enable) {
-        atc_mode mode = mode_data->second;
-        for (auto it = kAtcSubSetting.begin(); it != kAtcSubSetting.end(); it++) {
-            mAtcSubSetting[it->first.c_str()].value.store(mode.sub_setting[it->first.c_str()]);
-            if (mAtcSubSetting[it->first.c_str()].value.is_dirty()) {
-                if (writeIntToFile(mAtcSubSetting[it->first.c_str()].node,
-                                   mAtcSubSetting[it->first.c_str()].value.get()) != NO_ERROR)
-                    return -EPERM;
-                mAtcSubSetting[it->first.c_str()].value.clear_dirty();
+        const atc_mode &mode = mAtcModeSetting[mode_id];
+        for (size_t index = 0; index < kAtcSubSettingNum; index++) {
+            struct atc_sysfs &sub_setting = mAtcSubSetting[index];
+            sub_setting.value.store(mode.sub_setting[index]);
+            if (sub_setting.value.is_dirty()) {
+                queueAtcWrite(sub_setting, sub_setting.value.get());
+                sub_setting.value.clear_dirty();
             }
         }
-        mAtcStUpStep = mode.st_up_step;
-        mAtcStDownStep = mode.st_down_step;
+        setAtcStSteps(mode.st_up_step, mode.st_down_step);
+        mAtcStStepIntervalMs = std::max(mode.st_step_interval_ms, 1u);
 
-        uint32_t index = getAtcLuxMapIndex(mode.lux_map, mCurrentLux);
-        ambient_light = mode.lux_map[index].al;
-        strength = mode.lux_map[index].st;
+        uint32_t index = getAtcLuxMapIndex(mode, mCurrentLux);
+        ambient_light = mode.al[index];
+        strength = mode.st[index];
+        mAtcLuxMapIndex = index;
     }
 
     if (setAtcAmbientLight(ambient_light) != NO_ERROR) {
-        ALOGE("Fail to set atc ambient light for %s mode", mode_name.c_str());
+        ALOGE("Fail to set atc ambient light for %s mode", getAtcModeName(mode_id));
         return -EPERM;
     }
 
     if (setAtcStDimming(strength) != NO_ERROR) {
-        ALOGE("Fail to set atc st dimming for %s mode", mode_name.c_str());
+        ALOGE("Fail to set atc st dimming for %s mode", getAtcModeName(mode_id));
         return -EPERM;
     }
 
-    if (!enable && isInAtcAnimation()) {
-        mPendingAtcOff = true;
-    } else {
-        if (setAtcEnable(enable) != NO_ERROR) {
-            ALOGE("Fail to set atc enable = %d", enable);
-            return -EPERM;
+    {
+        /* the animator turns ATC off once the ramp down has finished */
+        Mutex::Autolock lock(mAtcEnableMutex);
+        if (!enable && mAtcStState.load(std::memory_order_acquire).count > 0) {
+            mPendingAtcOff = true;
+        } else {
+            mPendingAtcOff = false;
+            if (setAtcEnable(enable) != NO_ERROR) {
+                ALOGE("Fail to set atc enable = %d", enable);
+                return -EPERM;
+            }
         }
     }
 
-    mCurrentAtcModeName = enable ? mode_name : "NULL";
-    ALOGI("atc enable=%d (mode=%s, pending off=%s)", enable, mCurrentAtcModeName.c_str(),
+    mCurrentAtcMode = enable ? mode_id : ATC_MODE_NONE;
+    ALOGI("atc enable=%d (mode=%s, pending off=%s)", enable, getAtcModeName(mCurrentAtcMode),
           mPendingAtcOff ? "true" : "false");
     return NO_ERROR;
 }
 void ExynosPrimaryDisplayModule::setLbeState(LbeState state) {
     if (!mAtcInit) return;
-    std::string modeStr;
+    atc_mode_id mode_id = ATC_MODE_NONE;
     bool enhanced_hbm = false;
     switch (state) {
         case LbeState::OFF:
             mCurrentLux = 0;
             break;
         case LbeState::NORMAL:
-            modeStr = kAtcModeNormalStr;
+            mode_id = ATC_MODE_NORMAL;
             break;
         case LbeState::HIGH_BRIGHTNESS:
-            modeStr = kAtcModeHbmStr;
+            mode_id = ATC_MODE_HBM;
             enhanced_hbm = true;
             break;
         case LbeState::POWER_SAVE:
-            modeStr = kAtcModePowerSaveStr;
+            mode_id = ATC_MODE_POWER_SAVE;
             break;
         default:
             ALOGE("Lbe state not support");
             return;
     }
 
-    if (setAtcMode(modeStr) != NO_ERROR) return;
+    if (setAtcMode(mode_id) != NO_ERROR) return;
 
     mBrightnessController->processEnhancedHbm(enhanced_hbm);
     if (mCurrentLbeState != state) {
@@ -1027,22 +1331,31 @@ void ExynosPrimaryDisplayModule::setLbeState(LbeState state) {
 }
 
 void ExynosPrimaryDisplayModule::setLbeAmbientLight(int value) {
+    std::lock_guard<std::mutex> lock(mAtcLuxMutex);
+    applyAtcAmbientLight(value);
+}
+
+void ExynosPrimaryDisplayModule::recheckAtcLux() {
+    std::lock_guard<std::mutex> lock(mAtcLuxMutex);
+    applyAtcAmbientLight(mCurrentLux);
+}
+
+void ExynosPrimaryDisplayModule::applyAtcAmbientLight(uint32_t value) {
     if (!mAtcInit) return;
 
-    auto it = mAtcModeSetting.find(mCurrentAtcModeName);
-    if (it == mAtcModeSetting.end()) {
+    if (mCurrentAtcMode == ATC_MODE_NONE) {
         ALOGE("Atc mode not found");
         return;
     }
-    atc_mode mode = it->second;
+    const atc_mode &mode = mAtcModeSetting[mCurrentAtcMode];
 
-    uint32_t index = getAtcLuxMapIndex(mode.lux_map, value);
-    if (setAtcAmbientLight(mode.lux_map[index].al) != NO_ERROR) {
+    uint32_t index = filterAtcLuxMapIndex(mode, value);
+    if (setAtcAmbientLight(mode.al[index]) != NO_ERROR) {
         ALOGE("Failed to set atc ambient light");
         return;
     }
 
-    if (setAtcStDimming(mode.lux_map[index].st) != NO_ERROR) {
+    if (setAtcStDimming(mode.st[index]) != NO_ERROR) {
         ALOGE("Failed to set atc st dimming");
         return;
     }
@@ -1059,6 +1372,7 @@ LbeState ExynosPrimaryDisplayModule::getLbeState() {
 }
 
 PanelCalibrationStatus ExynosPrimaryDisplayModule::getPanelCalibrationStatus() {
+    /* uncalibrated until displaycolor has loaded the calibration */
     auto displayColorInterface = getDisplayColorInterface();
     if (displayColorInterface == nullptr) {
         return PanelCalibrationStatus::UNCALIBRATED;
@@ -1076,65 +1390,135 @@ PanelCalibrationStatus ExynosPrimaryDisplayModule::getPanelCalibrationStatus() {
     }
 }
 
-int32_t ExynosPrimaryDisplayModule::setAtcStDimming(uint32_t value) {
-    Mutex::Autolock lock(mAtcStMutex);
-    int32_t strength = mAtcStrength.value.get();
-    if (mAtcStTarget != value) {
-        mAtcStTarget = value;
-        uint32_t step = mAtcStTarget > strength ? mAtcStUpStep : mAtcStDownStep;
-
-        int diff = value - strength;
-        uint32_t count = (std::abs(diff) + step - 1) / step;
-        mAtcStStepCount = count;
-        ALOGI("setup atc st dimming=%d, count=%d, step=%d", value, count, step);
-    }
+atc_st_state ExynosPrimaryDisplayModule::updateAtcStState(uint32_t target) {
+    atc_st_state state = mAtcStState.load(std::memory_order_relaxed);
+    atc_st_state next;
+    do {
+        next = advanceAtcStState(state, target);
+    } while (!mAtcStState.compare_exchange_weak(state, next, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
 
-    if (mAtcStStepCount == 0 && !mAtcStrength.value.is_dirty()) return NO_ERROR;
+    if (next.target != state.target)
+        ALOGI("setup atc st dimming=%d, count=%d", next.target, next.count);
 
-    if ((strength + mAtcStUpStep) < mAtcStTarget) {
-        strength = strength + mAtcStUpStep;
-    } else if (strength > (mAtcStTarget + mAtcStDownStep)) {
-        strength = strength - mAtcStDownStep;
-    } else {
-        strength = mAtcStTarget;
-    }
-
-    if (setAtcStrength(strength) != NO_ERROR) {
-        ALOGE("Failed to set atc st");
-        return -EPERM;
-    }
+    if ((next.strength != state.strength) || mAtcStrengthDirty.exchange(false))
+        queueAtcStrengthWrite();
+    return next;
+}
 
-    if (mAtcStStepCount > 0) mAtcStStepCount--;
+int32_t ExynosPrimaryDisplayModule::setAtcStDimming(uint32_t value) {
+    if (updateAtcStState(value).count > 0) kickAtcAnimator();
     return NO_ERROR;
 }
 
+void ExynosPrimaryDisplayModule::setAtcStSteps(uint32_t up_step, uint32_t down_step) {
+    atc_st_state state = mAtcStState.load(std::memory_order_relaxed);
+    atc_st_state next;
+    do {
+        next = state;
+        next.up_step = std::clamp<uint32_t>(up_step, 1, UINT8_MAX);
+        next.down_step = std::clamp<uint32_t>(down_step, 1, UINT8_MAX);
+    } while (!mAtcStState.compare_exchange_weak(state, next, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+}
+
 int32_t ExynosPrimaryDisplayModule::setAtcEnable(bool enable) {
     mAtcEnable.value.store(enable);
     if (mAtcEnable.value.is_dirty()) {
-        if (writeIntToFile(mAtcEnable.node, enable) != NO_ERROR) return -EPERM;
+        queueAtcWrite(mAtcEnable, enable);
         mAtcEnable.value.clear_dirty();
     }
     return NO_ERROR;
 }
 
-void ExynosPrimaryDisplayModule::checkAtcAnimation() {
-    if (!isInAtcAnimation()) return;
+bool ExynosPrimaryDisplayModule::stepAtcAnimation() {
+    const atc_st_state state = mAtcStState.load(std::memory_order_acquire);
+    if (state.count == 0) return false;
 
-    if (setAtcStDimming(mAtcStTarget) != NO_ERROR) {
-        ALOGE("Failed to set atc st dimming");
-        return;
-    }
+    if (updateAtcStState(kAtcStKeepTarget).count > 0) return true;
 
-    if (mPendingAtcOff && mAtcStStepCount == 0) {
+    /* ramp finished, apply an off requested while it was running */
+    Mutex::Autolock lock(mAtcEnableMutex);
+    if (mPendingAtcOff && mAtcStState.load(std::memory_order_acquire).count == 0) {
         if (setAtcEnable(false) != NO_ERROR) {
             ALOGE("Failed to set atc enable to off");
-            return;
+            return false;
         }
         mPendingAtcOff = false;
         ALOGI("atc enable is off (pending off=false)");
     }
 
-    mDevice->onRefresh();
+    return false;
+}
+
+void ExynosPrimaryDisplayModule::kickAtcAnimator() {
+    {
+        std::lock_guard<std::mutex> lock(mAtcAnimatorMutex);
+        mAtcAnimatorKicks++;
+        mAtcAnimatorActive = true;
+    }
+    mAtcAnimatorCondition.notify_one();
+}
+
+void ExynosPrimaryDisplayModule::scheduleAtcLuxRecheck(nsecs_t time) {
+    {
+        std::lock_guard<std::mutex> lock(mAtcAnimatorMutex);
+        if ((mAtcLuxRecheckTime != 0) && (mAtcLuxRecheckTime <= time)) return;
+        mAtcLuxRecheckTime = time;
+    }
+    mAtcAnimatorCondition.notify_one();
+}
+
+bool ExynosPrimaryDisplayModule::runDueAtcLuxRecheck(std::unique_lock<std::mutex> &lock) {
+    if ((mAtcLuxRecheckTime == 0) ||
+        (systemTime(SYSTEM_TIME_MONOTONIC) < mAtcLuxRecheckTime))
+        return false;
+
+    mAtcLuxRecheckTime = 0;
+    lock.unlock();
+    recheckAtcLux();
+    lock.lock();
+    return true;
+}
+
+void ExynosPrimaryDisplayModule::atcAnimatorLoop() {
+    std::unique_lock<std::mutex> lock(mAtcAnimatorMutex);
+    while (true) {
+        mAtcAnimatorCondition.wait(lock, [this] {
+            return mAtcAnimatorExit || mAtcAnimatorActive || (mAtcLuxRecheckTime != 0);
+        });
+        if (mAtcAnimatorExit) break;
+
+        if (!mAtcAnimatorActive) {
+            /* only a lux transition held back by the rate limit is pending */
+            const nsecs_t recheckTime = mAtcLuxRecheckTime;
+            const nsecs_t delay = recheckTime - systemTime(SYSTEM_TIME_MONOTONIC);
+            if ((delay > 0) &&
+                mAtcAnimatorCondition.wait_for(lock, std::chrono::nanoseconds(delay),
+                                               [this, recheckTime] {
+                                                   return mAtcAnimatorExit ||
+                                                           mAtcAnimatorActive ||
+                                                           mAtcLuxRecheckTime != recheckTime;
+                                               }))
+                continue;
+            runDueAtcLuxRecheck(lock);
+            continue;
+        }
+
+        /* a kick restarts the period so a new ramp begins one interval after it was set up */
+        const uint64_t kicks = mAtcAnimatorKicks;
+        const auto interval = std::chrono::milliseconds(mAtcStStepIntervalMs.load());
+        if (mAtcAnimatorCondition.wait_for(lock, interval, [this, kicks] {
+                return mAtcAnimatorExit || mAtcAnimatorKicks != kicks;
+            }))
+            continue;
+
+        lock.unlock();
+        const bool animating = stepAtcAnimation();
+        lock.lock();
+        if (!animating && mAtcAnimatorKicks == kicks) mAtcAnimatorActive = false;
+        runDueAtcLuxRecheck(lock);
+    }
 }
 
 int32_t ExynosPrimaryDisplayModule::setPowerMode(int32_t mode) {
@@ -1143,11 +1527,35 @@ int32_t ExynosPrimaryDisplayModule::setPowerMode(int32_t mode) {
 
     ret = ExynosPrimaryDisplay::setPowerMode(mode);
 
+    if ((ret == HWC2_ERROR_NONE) && (mode == HWC_POWER_MODE_OFF) &&
+        (prevPowerModeState != HWC_POWER_MODE_OFF) && mReclaimColorBlobs) {
+        ExynosDisplayDrmInterfaceModule* moduleDisplayInterface =
+                static_cast<ExynosDisplayDrmInterfaceModule*>(mDisplayInterface.get());
+        const uint64_t liveBytes = moduleDisplayInterface->getLiveColorBlobBytes();
+
+        moduleDisplayInterface->reclaimColorBlobs();
+        /* the first frame after power on rebuilds every stage */
+        setForceColorUpdate(true);
+        ALOGD("%s: reclaimed %" PRIu64 " bytes of color blobs", __func__,
+              liveBytes - moduleDisplayInterface->getLiveColorBlobBytes());
+    }
+
+    if ((ret == HWC2_ERROR_NONE) && (prevPowerModeState == HWC_POWER_MODE_OFF) &&
+        (mode != HWC_POWER_MODE_OFF)) {
+        ExynosDisplayDrmInterfaceModule* moduleDisplayInterface =
+                static_cast<ExynosDisplayDrmInterfaceModule*>(mDisplayInterface.get());
+        /* the panel may have been replaced while it was off */
+        if (moduleDisplayInterface->refreshDisplayInfo()) setForceColorUpdate(true);
+    }
+
     if ((ret == HWC2_ERROR_NONE) && isDisplaySwitched(mode, prevPowerModeState)) {
         ExynosDeviceModule* device = static_cast<ExynosDeviceModule*>(mDevice);
 
         device->setActiveDisplay(mIndex);
         setForceColorUpdate(true);
+        /* blobs of the last delivery stay valid while switched out, unless reclaimed */
+        static_cast<ExynosDisplayDrmInterfaceModule*>(mDisplayInterface.get())
+                ->requestDqeCheckpointRestore();
     }
     return ret;
 }
@@ -1159,8 +1567,42 @@ bool ExynosPrimaryDisplayModule::isDisplaySwitched(int32_t mode, int32_t prevMod
             (mode != HWC_POWER_MODE_OFF);
 }
 
+void ExynosPrimaryDisplayModule::dump(String8& result) {
+    ExynosPrimaryDisplay::dump(result);
+
+    ExynosDeviceModule* device = static_cast<ExynosDeviceModule*>(mDevice);
+    ExynosDisplayDrmInterfaceModule* moduleDisplayInterface =
+            static_cast<ExynosDisplayDrmInterfaceModule*>(mDisplayInterface.get());
+
+    result.appendFormat("displaycolor load time: %" PRId64 " us\n",
+                        ns2us(device->getDisplayColorLoadTime()));
+    moduleDisplayInterface->dumpColorCommitStats(result);
+    static constexpr const char *kColorTransformClassNames[] = {"identity", "uniform scale",
+                                                                "affine", "general"};
+    result.appendFormat("color transform: %s, sdr dim ratio %f\n",
+            kColorTransformClassNames[static_cast<int>(mDisplaySceneInfo.colorTransformClass)],
+            mDisplaySceneInfo.dimSdrRatio);
+    result.appendFormat("dbv bucket %u, dbv changes: submitted %" PRIu64 " coalesced %" PRIu64
+                        "\n", mDbvBucket, mDbvChanges, mDbvCoalesced);
+    result.appendFormat("UpdatePresent: calls %" PRIu64 " skipped %" PRIu64 "\n",
+                        mUpdatePresentCalls, mUpdatePresentSkips);
+    if (mAtcInit) {
+        result.appendFormat("atc mode %s lux %u index %u, suppressed transitions: "
+                            "hysteresis %" PRIu64 " rate limit %" PRIu64 "\n",
+                            getAtcModeName(mCurrentAtcMode), mCurrentLux, mAtcLuxMapIndex,
+                            mAtcHysteresisSuppressed, mAtcRateLimitSuppressed);
+    }
+    ColorTrace::dump(result, mIndex);
+    /* the rings are shared by all displays, the primary one saves them */
+    if ((mIndex == 0) && property_get_bool(kColorTraceSaveProp, false) &&
+        ColorTrace::save(kColorTracePath))
+        result.appendFormat("color trace saved to %s\n", kColorTracePath);
+    result.appendFormat("\n");
+}
+
 bool ExynosPrimaryDisplayModule::isColorCalibratedByDevice() {
     const DisplayType display = getDisplayTypeFromIndex(mIndex);
     IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
+    if (displayColorInterface == nullptr) return false;
     return displayColorInterface->GetCalibrationInfo(display).factory_cal_loaded;
 };
@@ -16,8 +16,22 @@
 #ifndef EXYNOS_DISPLAY_MODULE_H
 #define EXYNOS_DISPLAY_MODULE_H
 
+#include <android-base/unique_fd.h>
 #include <gs101/displaycolor/displaycolor_gs101.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "AtcStState.h"
+#include "ColorTrace.h"
+#include "DisplaySceneTrace.h"
 #include "ExynosDeviceModule.h"
 #include "ExynosDisplay.h"
 #include "ExynosLayer.h"
@@ -43,35 +57,62 @@ constexpr char kAtcProfileStMapStr[] = "strength_map";
 constexpr char kAtcProfileSubSettingStr[] = "sub_setting";
 constexpr char kAtcProfileStUpStepStr[] = "st_up_step";
 constexpr char kAtcProfileStDownStepStr[] = "st_down_step";
+constexpr char kAtcProfileStStepIntervalStr[] = "st_step_interval_ms";
 constexpr uint32_t kAtcStStep = 2;
+/* default strength dimming step period, one step per frame at 60Hz */
+constexpr uint32_t kAtcStStepIntervalMs = 16;
+/* lux a reading must move past a lux map threshold before the index changes */
+constexpr char kAtcProfileLuxHysteresisStr[] = "lux_hysteresis";
+/* minimum time between two lux map index changes */
+constexpr char kAtcProfileMinTransitionIntervalStr[] = "min_transition_interval_ms";
 
 constexpr char kAtcModeNormalStr[] = "normal";
 constexpr char kAtcModeHbmStr[] = "hbm";
 constexpr char kAtcModePowerSaveStr[] = "power_save";
+/* indexed by ExynosPrimaryDisplayModule::atc_mode_id */
+constexpr const char *kAtcModeNames[] = {kAtcModeNormalStr, kAtcModeHbmStr,
+                                         kAtcModePowerSaveStr};
 
-#define ATC_AMBIENT_LIGHT_FILE_NAME "/sys/class/dqe%d/atc/ambient_light"
-#define ATC_ST_FILE_NAME "/sys/class/dqe%d/atc/st"
-#define ATC_ENABLE_FILE_NAME "/sys/class/dqe%d/atc/en"
-#define ATC_LT_FILE_NAME "/sys/class/dqe%d/atc/lt"
-#define ATC_NS_FILE_NAME "/sys/class/dqe%d/atc/ns"
-#define ATC_DITHER_FILE_NAME "/sys/class/dqe%d/atc/dither"
-#define ATC_PL_W1_FILE_NAME "/sys/class/dqe%d/atc/pl_w1"
-#define ATC_PL_W2_FILE_NAME "/sys/class/dqe%d/atc/pl_w2"
-#define ATC_CTMODE_FILE_NAME "/sys/class/dqe%d/atc/ctmode"
-#define ATC_PP_EN_FILE_NAME "/sys/class/dqe%d/atc/pp_en"
-#define ATC_UPGRADE_ON_FILE_NAME "/sys/class/dqe%d/atc/upgrade_on"
-#define ATC_TDR_MAX_FILE_NAME "/sys/class/dqe%d/atc/tdr_max"
-#define ATC_TDR_MIN_FILE_NAME "/sys/class/dqe%d/atc/tdr_min"
-#define ATC_BACKLIGHT_FILE_NAME "/sys/class/dqe%d/atc/back_light"
-#define ATC_DSTEP_FILE_NAME "/sys/class/dqe%d/atc/dstep"
-#define ATC_SCALE_MODE_FILE_NAME "/sys/class/dqe%d/atc/scale_mode"
-#define ATC_THRESHOLD_1_FILE_NAME "/sys/class/dqe%d/atc/threshold_1"
-#define ATC_THRESHOLD_2_FILE_NAME "/sys/class/dqe%d/atc/threshold_2"
-#define ATC_THRESHOLD_3_FILE_NAME "/sys/class/dqe%d/atc/threshold_3"
-#define ATC_GAIN_LIMIT_FILE_NAME "/sys/class/dqe%d/atc/gain_limit"
-#define ATC_LT_CALC_AB_SHIFT_FILE_NAME "/sys/class/dqe%d/atc/lt_calc_ab_shift"
-
-const std::unordered_map<std::string, std::string> kAtcSubSetting =
+/*
+ * dbv granularity of the color pipeline while brightness is ramping; a changing
+ * dbv is only passed to displaycolor when it crosses a bucket boundary. 0 disables.
+ */
+constexpr char kDbvBucketProp[] = "vendor.display.color.dbv_bucket";
+/* destroy the kept color property blobs when the display is powered off */
+constexpr char kColorReclaimBlobsProp[] = "vendor.display.color.reclaim_blobs";
+
+/* ATC nodes are relative to the sysfs root, which can be overridden for testing */
+constexpr char kAtcSysfsRootProp[] = "vendor.display.atc.sysfs_root";
+constexpr char kAtcSysfsRootDefault[] = "/sys/class";
+
+#define ATC_AMBIENT_LIGHT_FILE_NAME "dqe%d/atc/ambient_light"
+#define ATC_ST_FILE_NAME "dqe%d/atc/st"
+#define ATC_ENABLE_FILE_NAME "dqe%d/atc/en"
+#define ATC_LT_FILE_NAME "dqe%d/atc/lt"
+#define ATC_NS_FILE_NAME "dqe%d/atc/ns"
+#define ATC_DITHER_FILE_NAME "dqe%d/atc/dither"
+#define ATC_PL_W1_FILE_NAME "dqe%d/atc/pl_w1"
+#define ATC_PL_W2_FILE_NAME "dqe%d/atc/pl_w2"
+#define ATC_CTMODE_FILE_NAME "dqe%d/atc/ctmode"
+#define ATC_PP_EN_FILE_NAME "dqe%d/atc/pp_en"
+#define ATC_UPGRADE_ON_FILE_NAME "dqe%d/atc/upgrade_on"
+#define ATC_TDR_MAX_FILE_NAME "dqe%d/atc/tdr_max"
+#define ATC_TDR_MIN_FILE_NAME "dqe%d/atc/tdr_min"
+#define ATC_BACKLIGHT_FILE_NAME "dqe%d/atc/back_light"
+#define ATC_DSTEP_FILE_NAME "dqe%d/atc/dstep"
+#define ATC_SCALE_MODE_FILE_NAME "dqe%d/atc/scale_mode"
+#define ATC_THRESHOLD_1_FILE_NAME "dqe%d/atc/threshold_1"
+#define ATC_THRESHOLD_2_FILE_NAME "dqe%d/atc/threshold_2"
+#define ATC_THRESHOLD_3_FILE_NAME "dqe%d/atc/threshold_3"
+#define ATC_GAIN_LIMIT_FILE_NAME "dqe%d/atc/gain_limit"
+#define ATC_LT_CALC_AB_SHIFT_FILE_NAME "dqe%d/atc/lt_calc_ab_shift"
+
+struct atc_sub_setting_node {
+    const char *name;
+    const char *node;
+};
+
+constexpr atc_sub_setting_node kAtcSubSetting[] =
         {{"local_tone_gain", ATC_LT_FILE_NAME},
          {"noise_suppression_gain", ATC_NS_FILE_NAME},
          {"dither", ATC_DITHER_FILE_NAME},
@@ -90,6 +131,7 @@ const std::unordered_map<std::string, std::string> kAtcSubSetting =
          {"threshold_3", ATC_THRESHOLD_3_FILE_NAME},
          {"gain_limit", ATC_GAIN_LIMIT_FILE_NAME},
          {"lt_calc_ab_shift", ATC_LT_CALC_AB_SHIFT_FILE_NAME}};
+constexpr size_t kAtcSubSettingNum = std::size(kAtcSubSetting);
 
 namespace gs101 {
 
@@ -136,6 +178,26 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
 
         virtual PanelCalibrationStatus getPanelCalibrationStatus();
 
+        virtual void dump(String8& result) override;
+
+        /* Shape of a 4x4 color transform, row-vector layout with offsets in 12..14 */
+        enum class ColorTransformClass {
+            IDENTITY,
+            /* equal scale of R, G and B, no offsets */
+            UNIFORM_SCALE,
+            /* 3x3 coefficients plus offsets */
+            AFFINE,
+            GENERAL,
+        };
+        static constexpr std::array<float, TRANSFORM_MAT_SIZE> kIdentityColorTransform = {
+            1.0, 0.0, 0.0, 0.0,
+            0.0, 1.0, 0.0, 0.0,
+            0.0, 0.0, 1.0, 0.0,
+            0.0, 0.0, 0.0, 1.0
+        };
+        static ColorTransformClass classifyColorTransform(
+                const std::array<float, TRANSFORM_MAT_SIZE> &matrix);
+
         class DisplaySceneInfo {
             public:
                 struct LayerMappingInfo {
@@ -151,6 +213,10 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
                 bool colorSettingChanged = false;
                 bool displaySettingDelivered = false;
                 DisplayScene displayScene;
+                /* class of displayScene.matrix, updated when the matrix is set */
+                ColorTransformClass colorTransformClass = ColorTransformClass::IDENTITY;
+                float dimSdrRatio = 1.0f;
+                std::array<float, TRANSFORM_MAT_SIZE> dimScaleMatrix = kIdentityColorTransform;
 
                 /*
                  * Index of LayerColorData in DisplayScene::layer_data
@@ -197,14 +263,23 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
                 };
 
                 void setColorTransform(const float* matrix) {
-                    for (uint32_t i = 0; i < displayScene.matrix.size(); i++) {
-                        if (displayScene.matrix[i] != matrix[i]) {
-                            colorSettingChanged = true;
-                            displayScene.matrix[i] = matrix[i];
-                        }
+                    if (!std::equal(displayScene.matrix.begin(), displayScene.matrix.end(),
+                                    matrix)) {
+                        colorSettingChanged = true;
+                        std::copy(matrix, matrix + displayScene.matrix.size(),
+                                  displayScene.matrix.begin());
+                        colorTransformClass = classifyColorTransform(displayScene.matrix);
                     }
                 }
 
+                /* Set the per-frame SDR dim ratio and its scale matrix, rebuilt on change */
+                void setDimSdrRatio(float ratio) {
+                    if (ratio == dimSdrRatio) return;
+                    dimSdrRatio = ratio;
+                    dimScaleMatrix = kIdentityColorTransform;
+                    dimScaleMatrix[0] = dimScaleMatrix[5] = dimScaleMatrix[10] = ratio;
+                }
+
                 LayerColorData& getLayerColorDataInstance(uint32_t index);
                 int32_t setLayerDataMappingInfo(ExynosMPPSource* layer, uint32_t index);
                 void setLayerDataspace(LayerColorData& layerColorData,
@@ -213,7 +288,7 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
                 void setLayerHdrStaticMetadata(LayerColorData& layerColorData,
                         const ExynosHdrStaticInfo& exynosHdrStaticInfo);
                 void setLayerColorTransform(LayerColorData& layerColorData,
-                        std::array<float, TRANSFORM_MAT_SIZE> &matrix);
+                        const std::array<float, TRANSFORM_MAT_SIZE> &matrix);
                 void disableLayerHdrDynamicMetadata(LayerColorData& layerColorData);
                 void setLayerHdrDynamicMetadata(LayerColorData& layerColorData,
                         const ExynosHdrDynamicInfo& exynosHdrDynamicInfo);
@@ -223,8 +298,14 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
                     const ExynosCompositionInfo& clientCompositionInfo,
                     LayerColorData& layerData, float dimSdrRatio);
                 bool needDisplayColorSetting();
-                void printDisplayScene();
-                void printLayerColorData(const LayerColorData& layerData);
+                /* Hash of the scene level state displaycolor derives the DQE stages from */
+                uint64_t getDqeBootSceneHash() const;
+                /* getDqeBootSceneHash() extended with refresh rate and brightness */
+                uint64_t getDqeSceneHash(uint64_t bootHash) const;
+                /* Record a snapshot of the scene into ColorTrace */
+                void recordDisplayScene(uint32_t display);
+                void recordLayerColorData(uint32_t display, uint16_t index,
+                        const LayerColorData& layerData);
         };
 
         bool hasDisplayColor() {
@@ -232,20 +313,31 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
             return displayColorInterface != nullptr;
         }
 
+        /* IDpps of all layers of the scene, call only with displaycolor loaded */
+        std::vector<std::reference_wrapper<const IDisplayColorGS101::IDpp>> getDpps() {
+            waitDisplayColorUpdate();
+            const DisplayType display = getDisplayTypeFromIndex(mIndex);
+            return getDisplayColorInterface()->GetPipelineData(display)->Dpp();
+        }
         /* Call getDppForLayer() only if hasDppForLayer() is true */
         bool hasDppForLayer(ExynosMPPSource* layer);
         const IDisplayColorGS101::IDpp& getDppForLayer(ExynosMPPSource* layer);
         int32_t getDppIndexForLayer(ExynosMPPSource* layer);
         /* Check if layer's assigned plane id has changed, save the new planeId.
+         * prevPlaneId is UINT_MAX if the layer had no plane with the same dppIdx.
          * call only if hasDppForLayer is true */
-        bool checkAndSaveLayerPlaneId(ExynosMPPSource* layer, uint32_t planeId) {
+        bool checkAndSaveLayerPlaneId(ExynosMPPSource* layer, uint32_t planeId,
+                                      uint32_t *prevPlaneId = nullptr) {
             auto &info = mDisplaySceneInfo.layerDataMappingInfo[layer];
             bool change = info.planeId != planeId;
+            if (prevPlaneId)
+                *prevPlaneId = info.planeId;
             info.planeId = planeId;
             return change;
         }
 
         size_t getNumOfDpp() {
+            waitDisplayColorUpdate();
             const DisplayType display = getDisplayTypeFromIndex(mIndex);
             IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
             return displayColorInterface->GetPipelineData(display)->Dpp().size();
@@ -253,6 +345,7 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
 
         const IDisplayColorGS101::IDqe& getDqe()
         {
+            waitDisplayColorUpdate();
             const DisplayType display = getDisplayTypeFromIndex(mIndex);
             IDisplayColorGS101* displayColorInterface = getDisplayColorInterface();
             return displayColorInterface->GetPipelineData(display)->Dqe();
@@ -261,41 +354,82 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
         // primary or secondary
         DisplayType getBuiltInDisplayType() { return getDisplayTypeFromIndex(mIndex); }
 
+        const DisplayScene& getDisplayScene() { return mDisplaySceneInfo.displayScene; }
+
     private:
         int32_t setLayersColorData();
+        void traceDisplayScene(DisplaySceneTrace::RecordType type);
         DisplaySceneInfo mDisplaySceneInfo;
-
-        struct atc_lux_map {
-            uint32_t lux;
-            uint32_t al;
-            uint32_t st;
+        /* set only while vendor.display.color.scene_capture is enabled */
+        std::unique_ptr<DisplaySceneTrace> mDisplaySceneTrace;
+
+        enum atc_mode_id : uint32_t {
+            ATC_MODE_NORMAL,
+            ATC_MODE_HBM,
+            ATC_MODE_POWER_SAVE,
+            ATC_MODE_NUM,
+            ATC_MODE_NONE = ATC_MODE_NUM,
         };
+        static_assert(std::size(kAtcModeNames) == ATC_MODE_NUM, "atc mode name missing");
 
+        /* Compiled from the ATC profile once in parseAtcProfile() and read-only afterwards */
         struct atc_mode {
-            std::vector<atc_lux_map> lux_map;
-            std::unordered_map<std::string, int32_t> sub_setting;
+            bool valid = false;
+            /* ascending lux thresholds and the ambient light/strength of each */
+            std::vector<uint32_t> lux;
+            std::vector<uint32_t> al;
+            std::vector<uint32_t> st;
+            /* indexed like kAtcSubSetting */
+            std::array<int32_t, kAtcSubSettingNum> sub_setting;
             uint32_t st_up_step;
             uint32_t st_down_step;
+            uint32_t st_step_interval_ms;
+            uint32_t lux_hysteresis;
+            nsecs_t min_transition_interval;
         };
         struct atc_sysfs {
             String8 node;
             CtrlValue<int32_t> value;
+            /* opened in initLbe() and kept open, reopened if a write fails */
+            android::base::unique_fd fd;
         };
 
         bool parseAtcProfile();
-        int32_t setAtcMode(std::string mode_name);
-        uint32_t getAtcLuxMapIndex(std::vector<atc_lux_map>, uint32_t lux);
+        void initAtcSysfs(struct atc_sysfs &sysfs, const std::string &root, const char *node);
+        int32_t writeAtcSysfs(struct atc_sysfs &sysfs, int32_t value);
+        /* queue a node write for the ATC writer thread, replacing a pending write of the node */
+        void queueAtcWrite(struct atc_sysfs &sysfs, int32_t value);
+        void queueAtcWriteLocked(struct atc_sysfs &sysfs, int32_t value);
+        void queueAtcStrengthWrite();
+        void atcWriterLoop();
+        int32_t setAtcMode(atc_mode_id mode_id);
+        static uint32_t getAtcLuxMapIndex(const atc_mode &mode, uint32_t lux);
+        /* lux map index for lux after applying the mode's hysteresis and rate limit */
+        uint32_t filterAtcLuxMapIndex(const atc_mode &mode, uint32_t lux);
+        void applyAtcAmbientLight(uint32_t value);
+        /* re-apply the last lux, for a transition held back by the rate limit */
+        void recheckAtcLux();
+        /* have mAtcAnimatorThread call recheckAtcLux() at time, the earliest request wins */
+        void scheduleAtcLuxRecheck(nsecs_t time);
+        /* called with mAtcAnimatorMutex held, drops it while rechecking */
+        bool runDueAtcLuxRecheck(std::unique_lock<std::mutex> &lock);
+        static const char *getAtcModeName(atc_mode_id mode_id) {
+            return mode_id < ATC_MODE_NUM ? kAtcModeNames[mode_id] : "NULL";
+        }
         int32_t setAtcAmbientLight(uint32_t ambient_light);
-        int32_t setAtcStrength(uint32_t strenght);
+        /*
+         * ATC strength dimming state, updated as one atomic snapshot so the
+         * LBE callers and the animator never wait on each other.
+         */
+        /* Apply advanceAtcStState() to mAtcStState */
+        atc_st_state updateAtcStState(uint32_t target);
+        void setAtcStSteps(uint32_t up_step, uint32_t down_step);
         int32_t setAtcStDimming(uint32_t target);
         int32_t setAtcEnable(bool enable);
-        void checkAtcAnimation();
-        bool isInAtcAnimation() {
-            if (mAtcStStepCount > 0)
-                return true;
-            else
-                return false;
-        };
+        /* Advance strength dimming by one step, returns true while animating */
+        bool stepAtcAnimation();
+        void kickAtcAnimator();
+        void atcAnimatorLoop();
 
         DisplayType getDisplayTypeFromIndex(uint32_t index) {
             return (index >= DisplayType::DISPLAY_MAX) ? DisplayType::DISPLAY_PRIMARY
@@ -307,27 +441,119 @@ class ExynosPrimaryDisplayModule : public ExynosPrimaryDisplay {
             return device->getDisplayColorInterface();
         }
 
+        bool isDisplayColorLoading() {
+            ExynosDeviceModule* device = (ExynosDeviceModule*)mDevice;
+            return device->isDisplayColorLoading();
+        }
+
+        /*
+         * Color modes of displaycolor, the native mode of the pass-through path
+         * while displaycolor is still loading, none if it failed to load
+         */
+        const ColorModesMap &getColorModesMap();
+
         bool isForceColorUpdate() const { return mForceColorUpdate; }
-        void setForceColorUpdate(bool force) { mForceColorUpdate = force; }
+        void setForceColorUpdate(bool force) {
+            mForceColorUpdate = force;
+            if (force) mPresentInputsValid = false;
+        }
         bool isDisplaySwitched(int32_t mode, int32_t prevMode);
 
-        std::map<std::string, atc_mode> mAtcModeSetting;
+        std::array<atc_mode, ATC_MODE_NUM> mAtcModeSetting;
         bool mAtcInit;
         LbeState mCurrentLbeState = LbeState::OFF;
-        std::string mCurrentAtcModeName;
+        atc_mode_id mCurrentAtcMode = ATC_MODE_NONE;
         uint32_t mCurrentLux = 0;
         uint32_t mAtcLuxMapIndex = 0;
+        nsecs_t mAtcLuxMapIndexTime = 0;
+        /* lux map index changes held back by the hysteresis band or the rate limit */
+        uint64_t mAtcHysteresisSuppressed = 0;
+        uint64_t mAtcRateLimitSuppressed = 0;
+        /* serializes lux updates from the service and the animator recheck */
+        std::mutex mAtcLuxMutex;
         struct atc_sysfs mAtcAmbientLight;
         struct atc_sysfs mAtcStrength;
         struct atc_sysfs mAtcEnable;
-        std::unordered_map<std::string, struct atc_sysfs> mAtcSubSetting;
-        uint32_t mAtcStStepCount = 0;
-        uint32_t mAtcStTarget = 0;
-        uint32_t mAtcStUpStep;
-        uint32_t mAtcStDownStep;
-        Mutex mAtcStMutex;
-        bool mPendingAtcOff;
+        std::array<struct atc_sysfs, kAtcSubSettingNum> mAtcSubSetting;
+        std::atomic<atc_st_state> mAtcStState{atc_st_state{0, 0, 0, kAtcStStep, kAtcStStep}};
+        /* the first strength is written even if it matches the initial state */
+        std::atomic<bool> mAtcStrengthDirty = true;
+        /* serializes enable against the deferred off at the end of a ramp */
+        Mutex mAtcEnableMutex;
+        bool mPendingAtcOff = false;
+
+        /*
+         * ATC sysfs writes are issued by mAtcWriterThread. The queue holds at
+         * most one write per node and is kept in the order of the last write
+         * of each node, so enable is still applied after the settings queued
+         * before it.
+         */
+        std::thread mAtcWriterThread;
+        std::mutex mAtcWriterMutex;
+        std::condition_variable mAtcWriterCondition;
+        std::vector<std::pair<struct atc_sysfs*, int32_t>> mAtcWriteQueue;
+        bool mAtcWriterExit = false;
+
+        /*
+         * Strength dimming is stepped by mAtcAnimatorThread every
+         * mAtcStStepIntervalMs instead of once per frame, so a ramp neither
+         * waits for nor requests display refreshes.
+         */
+        std::thread mAtcAnimatorThread;
+        std::mutex mAtcAnimatorMutex;
+        std::condition_variable mAtcAnimatorCondition;
+        std::atomic<uint32_t> mAtcStStepIntervalMs = kAtcStStepIntervalMs;
+        /* bumped for every animation (re)start, to not lose a kick racing the last step */
+        uint64_t mAtcAnimatorKicks = 0;
+        bool mAtcAnimatorActive = false;
+        /* when a lux transition held back by the rate limit is re-applied, 0 if none */
+        nsecs_t mAtcLuxRecheckTime = 0;
+        bool mAtcAnimatorExit = false;
         bool mForceColorUpdate = false;
+        /* displaycolor has been observed at the start of a frame */
+        bool mDisplayColorReady = false;
+
+        int32_t updateDisplayColor(IDisplayColorGS101* displayColorInterface);
+        /*
+         * Join the Update() of the last scene if it runs on the color worker
+         * pool, before displaycolor data is read or the scene is rebuilt.
+         * Returns the Update() result.
+         */
+        int32_t waitDisplayColorUpdate();
+        /* guards mDisplayColorUpdate, the IDpp/IDqe accessors can be called from several threads */
+        std::mutex mDisplayColorUpdateMutex;
+        std::future<int32_t> mDisplayColorUpdate;
+
+        /*
+         * dbv of the scene for a brightness level, shared by Update() and
+         * UpdatePresent() so both see the same bucketed value in a frame.
+         */
+        uint32_t getSceneDbv(uint32_t level);
+        /* getSceneDbv() for the present, advances the ramp tracking */
+        uint32_t getPresentDbv();
+        uint32_t mDbvBucket = 0;
+        /* brightness level of the previous present, to tell ramps from steady state */
+        uint32_t mLastBrightnessLevel = 0;
+        /* presents whose dbv change was absorbed by a bucket */
+        uint64_t mDbvCoalesced = 0;
+        uint64_t mDbvChanges = 0;
+
+        /* scene fields refreshed for UpdatePresent(), as last passed to displaycolor */
+        struct present_inputs {
+            decltype(DisplayScene::refresh_rate) refreshRate;
+            decltype(DisplayScene::lhbm_on) lhbmOn;
+            decltype(DisplayScene::dbv) dbv;
+
+            bool operator==(const present_inputs &rhs) const {
+                return refreshRate == rhs.refreshRate && lhbmOn == rhs.lhbmOn && dbv == rhs.dbv;
+            }
+        };
+        present_inputs mPresentInputs{};
+        /* cleared by Update() and forced color updates */
+        bool mPresentInputsValid = false;
+        uint64_t mUpdatePresentCalls = 0;
+        uint64_t mUpdatePresentSkips = 0;
+        bool mReclaimColorBlobs = false;
 
     protected:
         virtual int32_t setPowerMode(int32_t mode) override;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "AtcStState.h"
+
+/*
+ * Contention on the ATC strength dimming state. Thread 0 takes dimming steps
+ * like the ATC animator, the other threads retarget the strength like binder
+ * LBE updates. LockFree is the std::atomic<atc_st_state> compare-and-swap of
+ * ExynosPrimaryDisplayModule, Mutex the same transition under a std::mutex as
+ * before. Besides the mean time per update of all threads, the p99 and max
+ * latency of the steps of thread 0 are reported.
+ */
+
+using namespace gs101;
+
+namespace {
+
+constexpr atc_st_state kInitialState = {0, 0, 0, 2, 2};
+
+class LockFreeAtcSt {
+    public:
+        void reset() { mState.store(kInitialState); }
+        atc_st_state update(uint32_t target) {
+            atc_st_state state = mState.load(std::memory_order_relaxed);
+            atc_st_state next;
+            do {
+                next = advanceAtcStState(state, target);
+            } while (!mState.compare_exchange_weak(state, next, std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed));
+            return next;
+        }
+
+    private:
+        std::atomic<atc_st_state> mState{kInitialState};
+};
+
+class MutexAtcSt {
+    public:
+        void reset() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mState = kInitialState;
+        }
+        atc_st_state update(uint32_t target) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mState = advanceAtcStState(mState, target);
+            return mState;
+        }
+
+    private:
+        std::mutex mMutex;
+        atc_st_state mState = kInitialState;
+};
+
+template <typename AtcStT>
+void BM_AtcStUpdate(benchmark::State &state) {
+    static AtcStT atcSt;
+    const bool animator = (state.thread_index() == 0);
+    if (animator) atcSt.reset();
+
+    std::vector<int64_t> stepNs;
+    uint32_t target = 0;
+    for (auto _ : state) {
+        if (!animator) {
+            /* keep the ramp running, alternating between two far apart targets */
+            target = (target == 200) ? 3000 : 200;
+            benchmark::DoNotOptimize(atcSt.update(target));
+            continue;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        benchmark::DoNotOptimize(atcSt.update(kAtcStKeepTarget));
+        stepNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count());
+    }
+
+    if (animator && !stepNs.empty()) {
+        std::sort(stepNs.begin(), stepNs.end());
+        state.counters["step_p99_ns"] = stepNs[(stepNs.size() - 1) * 99 / 100];
+        state.counters["step_max_ns"] = stepNs.back();
+    }
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_AtcStUpdate, LockFreeAtcSt)->ThreadRange(1, 4)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AtcStUpdate, MutexAtcSt)->ThreadRange(1, 4)->UseRealTime();
+
+BENCHMARK_MAIN();
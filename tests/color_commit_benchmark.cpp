@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <drm/drm_mode.h>
+#include <drm/samsung_drm.h>
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <gs101/displaycolor/lut_data.h>
+#include <gs101/displaycolor/matrix_data.h>
+
+#include <array>
+#include <cstring>
+#include <vector>
+
+/*
+ * Color commit cost of synthetic scenes against libdisplaycolor_stub.
+ *
+ * Every frame runs displaycolor Update() and UpdatePresent() for the scene,
+ * then serializes each enabled and dirty DQE and DPP stage into its
+ * drm/samsung_drm.h payload the way ExynosDisplayDrmInterfaceModule does for
+ * a frame that is not forced. The payloads go to FakeDrmDevice, which copies
+ * them like the blob ioctl does and counts blob creates, destroys, bytes and
+ * atomic properties. The counters are reported per frame next to the time.
+ */
+
+using namespace displaycolor;
+using namespace gs101;
+
+namespace {
+
+using IDpp = IDisplayColorGS101::IDpp;
+using IDqe = IDisplayColorGS101::IDqe;
+
+constexpr DisplayType kDisplay = DISPLAY_PRIMARY;
+constexpr uint32_t kUiLayers = 3;
+
+/* Stand-in for the blob and atomic property calls of DrmDevice */
+class FakeDrmDevice {
+    public:
+        int CreatePropertyBlob(const void *data, size_t length, uint32_t *blobId) {
+            if (mBlobData.size() < length) mBlobData.resize(length);
+            memcpy(mBlobData.data(), data, length);
+            creates++;
+            bytes += length;
+            *blobId = ++mLastBlobId;
+            return 0;
+        }
+        int DestroyPropertyBlob(uint32_t blobId) {
+            if (blobId != 0) destroys++;
+            return 0;
+        }
+        void AddProperty(uint32_t /* blobId */) { properties++; }
+
+        uint64_t creates = 0;
+        uint64_t destroys = 0;
+        uint64_t bytes = 0;
+        uint64_t properties = 0;
+
+    private:
+        std::vector<uint8_t> mBlobData;
+        uint32_t mLastBlobId = 0;
+};
+
+/* Blobs of one display, replaced as ExynosDisplayDrmInterfaceModule replaces them */
+class ColorCommit {
+    public:
+        explicit ColorCommit(FakeDrmDevice &drm) : mDrm(drm) {}
+
+        void commit(const IDisplayColorGS101::IDisplayPipelineData &pipeline) {
+            const IDqe &dqe = pipeline.Dqe();
+            commitStage(dqe.Cgc(), mDqeBlobs[0], [](const auto &config) {
+                static_assert(sizeof(config) == sizeof(struct cgc_lut), "cgc_lut layout");
+                return Payload{&config, sizeof(struct cgc_lut)};
+            });
+            commitStage(dqe.DegammaLut(), mDqeBlobs[1], [this](const auto &config) {
+                expandLut(config.values, mDegamma);
+                return Payload{mDegamma, sizeof(mDegamma)};
+            });
+            commitStage(dqe.RegammaLut(), mDqeBlobs[2], [this](const auto &config) {
+                interleaveLut(config.r_values, config.g_values, config.b_values, mRegamma);
+                return Payload{mRegamma, sizeof(mRegamma)};
+            });
+            commitStage(dqe.GammaMatrix(), mDqeBlobs[3], [this](const auto &config) {
+                convertMatrixData(config, mGammaMatrix.coeffs, mGammaMatrix.offsets);
+                return Payload{&mGammaMatrix, sizeof(mGammaMatrix)};
+            });
+            commitStage(dqe.LinearMatrix(), mDqeBlobs[4], [this](const auto &config) {
+                convertMatrixData(config, mLinearMatrix.coeffs, mLinearMatrix.offsets);
+                return Payload{&mLinearMatrix, sizeof(mLinearMatrix)};
+            });
+
+            const auto dpps = pipeline.Dpp();
+            mDppBlobs.resize(dpps.size());
+            for (size_t i = 0; i < dpps.size(); i++) commitDpp(dpps[i].get(), mDppBlobs[i]);
+        }
+
+    private:
+        struct Payload {
+            const void *data;
+            size_t size;
+        };
+
+        void commitDpp(const IDpp &dpp, std::array<uint32_t, 4> &blobs) {
+            commitStage(dpp.EotfLut(), blobs[0], [](const auto &config) {
+                static_assert(sizeof(config.tf_data) == sizeof(struct hdr_eotf_lut),
+                              "hdr_eotf_lut layout");
+                return Payload{&config.tf_data, sizeof(struct hdr_eotf_lut)};
+            });
+            commitStage(dpp.Gm(), blobs[1], [this](const auto &config) {
+                convertMatrixData(config, mGm.coeffs, mGm.offsets);
+                return Payload{&mGm, sizeof(mGm)};
+            });
+            commitStage(dpp.Dtm(), blobs[2], [this](const auto &config) {
+                for (uint32_t i = 0; i < DRM_SAMSUNG_HDR_TM_LUT_LEN; i++) {
+                    mTm.posx[i] = config.tf_data.posx[i];
+                    mTm.posy[i] = config.tf_data.posy[i];
+                }
+                mTm.coeff_r = config.coeff_r;
+                mTm.coeff_g = config.coeff_g;
+                mTm.coeff_b = config.coeff_b;
+                mTm.rng_x_min = config.rng_x_min;
+                mTm.rng_x_max = config.rng_x_max;
+                mTm.rng_y_min = config.rng_y_min;
+                mTm.rng_y_max = config.rng_y_max;
+                return Payload{&mTm, sizeof(mTm)};
+            });
+            commitStage(dpp.OetfLut(), blobs[3], [this](const auto &config) {
+                for (uint32_t i = 0; i < DRM_SAMSUNG_HDR_OETF_LUT_LEN; i++) {
+                    mOetf.posx[i] = config.tf_data.posx[i];
+                    mOetf.posy[i] = config.tf_data.posy[i];
+                }
+                return Payload{&mOetf, sizeof(mOetf)};
+            });
+        }
+
+        /* a clean stage keeps its blob and adds no property */
+        template <typename StageT, typename SerializeT>
+        void commitStage(const StageT &stage, uint32_t &blobId, SerializeT serialize) {
+            if (stage.enable && !stage.dirty) return;
+
+            uint32_t newBlobId = 0;
+            if (stage.enable) {
+                const Payload payload = serialize(*stage.config);
+                mDrm.CreatePropertyBlob(payload.data, payload.size, &newBlobId);
+            }
+            if ((newBlobId == 0) && (blobId == 0)) return;
+
+            mDrm.AddProperty(newBlobId);
+            mDrm.DestroyPropertyBlob(blobId);
+            blobId = newBlobId;
+            stage.NotifyDataApplied();
+        }
+
+        FakeDrmDevice &mDrm;
+        uint32_t mDqeBlobs[5] = {};
+        std::vector<std::array<uint32_t, 4>> mDppBlobs;
+
+        struct drm_color_lut mDegamma[IDqe::DegammaLutData::ConfigType::kLutLen];
+        struct drm_color_lut mRegamma[IDqe::RegammaLutData::ConfigType::kChannelLutLen];
+        struct exynos_matrix mGammaMatrix;
+        struct exynos_matrix mLinearMatrix;
+        struct hdr_gm_data mGm;
+        struct hdr_tm_data mTm;
+        struct hdr_oetf_lut mOetf;
+};
+
+enum Workload {
+    STATIC_UI,
+    BRIGHTNESS_RAMP,
+    HDR10_VIDEO,
+    HDR10_PLUS_VIDEO,
+    MODE_TOGGLE,
+};
+
+DisplayScene makeScene(Workload workload) {
+    DisplayScene scene;
+    scene.color_mode = hwc::ColorMode::SRGB;
+    scene.dbv = 500;
+    scene.layer_data.resize(kUiLayers);
+    for (auto &layer : scene.layer_data) layer.dataspace = hwc::Dataspace::SRGB;
+
+    if ((workload == HDR10_VIDEO) || (workload == HDR10_PLUS_VIDEO)) {
+        LayerColorData video;
+        video.dataspace = hwc::Dataspace::BT2020_PQ;
+        video.static_metadata.is_valid = true;
+        video.static_metadata.max_luminance = 1000;
+        video.static_metadata.max_content_light_level = 1000;
+        video.dynamic_metadata.is_valid = (workload == HDR10_PLUS_VIDEO);
+        scene.layer_data.insert(scene.layer_data.begin(), video);
+        scene.hdr_layer_state = HdrLayerState::kHdrLarge;
+    }
+    return scene;
+}
+
+/* what changes from one frame of the workload to the next */
+void nextFrame(Workload workload, DisplayScene &scene, uint32_t frame) {
+    switch (workload) {
+        case STATIC_UI:
+        case HDR10_VIDEO:
+            break;
+        case BRIGHTNESS_RAMP:
+            scene.dbv = 100 + (frame % 900);
+            break;
+        case HDR10_PLUS_VIDEO: {
+            auto &metadata = scene.layer_data[0].dynamic_metadata;
+            metadata.display_maximum_luminance = 400 + (frame % 600);
+            for (auto &maxscl : metadata.maxscl) maxscl = 1000 + frame % 3000;
+            break;
+        }
+        case MODE_TOGGLE:
+            scene.color_mode = (frame % 2) ? hwc::ColorMode::DISPLAY_P3 : hwc::ColorMode::SRGB;
+            break;
+    }
+}
+
+IDisplayColorGS101 *getDisplayColor() {
+    static IDisplayColorGS101 *displayColor =
+            GetDisplayColorGS101(std::vector<DisplayInfo>(1));
+    return displayColor;
+}
+
+void BM_ColorCommit(benchmark::State &state, Workload workload) {
+    IDisplayColorGS101 *displayColor = getDisplayColor();
+    if (displayColor == nullptr) {
+        state.SkipWithError("no displaycolor stub");
+        return;
+    }
+
+    FakeDrmDevice drm;
+    ColorCommit commit(drm);
+    DisplayScene scene = makeScene(workload);
+    uint32_t frame = 0;
+
+    for (auto _ : state) {
+        nextFrame(workload, scene, frame++);
+        displayColor->Update(kDisplay, scene);
+        displayColor->UpdatePresent(kDisplay, scene);
+        commit.commit(*displayColor->GetPipelineData(kDisplay));
+    }
+
+    using benchmark::Counter;
+    state.counters["blobs/frame"] = Counter(drm.creates, Counter::kAvgIterations);
+    state.counters["destroys/frame"] = Counter(drm.destroys, Counter::kAvgIterations);
+    state.counters["bytes/frame"] = Counter(drm.bytes, Counter::kAvgIterations);
+    state.counters["props/frame"] = Counter(drm.properties, Counter::kAvgIterations);
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_ColorCommit, static_ui, STATIC_UI);
+BENCHMARK_CAPTURE(BM_ColorCommit, brightness_ramp, BRIGHTNESS_RAMP);
+BENCHMARK_CAPTURE(BM_ColorCommit, hdr10_video, HDR10_VIDEO);
+BENCHMARK_CAPTURE(BM_ColorCommit, hdr10_plus_video, HDR10_PLUS_VIDEO);
+BENCHMARK_CAPTURE(BM_ColorCommit, mode_toggle, MODE_TOGGLE);
+
+BENCHMARK_MAIN();
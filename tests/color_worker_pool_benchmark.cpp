@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <gs101/displaycolor/lut_data.h>
+
+#include <chrono>
+#include <future>
+
+#include "ColorWorkerPool.h"
+
+/*
+ * Frames of two built-in displays against libdisplaycolor_stub, with the
+ * displaycolor Update() of each display run on the HWC thread (Serial) or on
+ * ColorWorkerPool from validate until present (Pooled), as with
+ * vendor.display.color.async_prepare. The first argument is the time in us
+ * the rest of the validate of a display keeps the HWC thread busy, the second
+ * one whether the scene changes every frame, which makes every stage dirty.
+ */
+
+using namespace displaycolor;
+using namespace gs101;
+
+namespace {
+
+constexpr uint32_t kDisplays = 2;
+constexpr uint32_t kLayers = 4;
+constexpr uint32_t kWorkerThreads = 2;
+
+/* same layout as drm_color_lut */
+struct ColorLut {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t reserved;
+};
+
+void busyWait(int64_t us) {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+class TwoDisplayFrames {
+    public:
+        TwoDisplayFrames() {
+            std::vector<DisplayInfo> displayInfo(kDisplays);
+            mDisplayColor = GetDisplayColorGS101(displayInfo);
+            for (auto &scene : mScenes) scene.layer_data.resize(kLayers);
+        }
+
+        bool valid() const { return mDisplayColor != nullptr; }
+
+        void nextScene(uint32_t display, bool changed, uint32_t frame) {
+            DisplayScene &scene = mScenes[display];
+            if (changed) {
+                scene.matrix[0] = 1.0f - (frame % 64) / 256.0f;
+                for (auto &layer : scene.layer_data) layer.dim_ratio = scene.matrix[0];
+            }
+        }
+
+        int update(uint32_t display) {
+            return mDisplayColor->Update(static_cast<DisplayType>(display), mScenes[display]);
+        }
+
+        /* UpdatePresent() and the DQE LUT conversion of the dirty stages */
+        void present(uint32_t display, uint32_t frame) {
+            const DisplayType type = static_cast<DisplayType>(display);
+            mScenes[display].dbv = 500 + (frame % 2);
+            mDisplayColor->UpdatePresent(type, mScenes[display]);
+
+            const IDisplayColorGS101::IDqe &dqe = mDisplayColor->GetPipelineData(type)->Dqe();
+            if (dqe.DegammaLut().dirty) {
+                expandLut(dqe.DegammaLut().config->values, mDegamma);
+                dqe.DegammaLut().NotifyDataApplied();
+            }
+            if (dqe.RegammaLut().dirty) {
+                const auto &regamma = *dqe.RegammaLut().config;
+                interleaveLut(regamma.r_values, regamma.g_values, regamma.b_values, mRegamma);
+                dqe.RegammaLut().NotifyDataApplied();
+            }
+            benchmark::DoNotOptimize(mDegamma);
+            benchmark::DoNotOptimize(mRegamma);
+        }
+
+    private:
+        IDisplayColorGS101 *mDisplayColor = nullptr;
+        DisplayScene mScenes[kDisplays];
+        ColorLut mDegamma[IDisplayColorGS101::IDqe::DegammaLutData::ConfigType::kLutLen];
+        ColorLut mRegamma[IDisplayColorGS101::IDqe::RegammaLutData::ConfigType::kChannelLutLen];
+};
+
+void BM_TwoDisplayFrameSerial(benchmark::State &state) {
+    TwoDisplayFrames frames;
+    if (!frames.valid()) {
+        state.SkipWithError("no displaycolor stub");
+        return;
+    }
+    uint32_t frame = 0;
+    for (auto _ : state) {
+        for (uint32_t display = 0; display < kDisplays; display++) {
+            frames.nextScene(display, state.range(1), frame);
+            busyWait(state.range(0));
+            frames.update(display);
+        }
+        for (uint32_t display = 0; display < kDisplays; display++)
+            frames.present(display, frame);
+        frame++;
+    }
+}
+
+void BM_TwoDisplayFramePooled(benchmark::State &state) {
+    TwoDisplayFrames frames;
+    if (!frames.valid()) {
+        state.SkipWithError("no displaycolor stub");
+        return;
+    }
+    ColorWorkerPool pool(kWorkerThreads);
+    std::future<int32_t> updates[kDisplays];
+    uint32_t frame = 0;
+    for (auto _ : state) {
+        for (uint32_t display = 0; display < kDisplays; display++) {
+            frames.nextScene(display, state.range(1), frame);
+            busyWait(state.range(0));
+            updates[display] = pool.post([&frames, display]() { return frames.update(display); });
+        }
+        for (uint32_t display = 0; display < kDisplays; display++) {
+            updates[display].get();
+            frames.present(display, frame);
+        }
+        frame++;
+    }
+}
+
+/* handoff cost paid by every posted work item */
+void BM_PoolRoundTrip(benchmark::State &state) {
+    ColorWorkerPool pool(kWorkerThreads);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pool.post([]() { return 0; }).get());
+    }
+}
+
+}  // namespace
+
+BENCHMARK(BM_TwoDisplayFrameSerial)->ArgsProduct({{0, 200}, {0, 1}})->UseRealTime();
+BENCHMARK(BM_TwoDisplayFramePooled)->ArgsProduct({{0, 200}, {0, 1}})->UseRealTime();
+BENCHMARK(BM_PoolRoundTrip)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <gs101/displaycolor/lut_data.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+
+using namespace displaycolor;
+
+namespace {
+
+/* same shape as drm_color_lut in drm/drm_mode.h, takes the NEON path on arm64 */
+struct Rgbx16Entry {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t reserved;
+};
+
+/* not four uint16_t fields, always takes the scalar path */
+struct Rgbx32Entry {
+    uint32_t red;
+    uint32_t green;
+    uint32_t blue;
+    uint32_t reserved;
+};
+
+static_assert(gs101::lut_data_detail::isRgbx16Entry<Rgbx16Entry>(), "Rgbx16Entry layout");
+static_assert(!gs101::lut_data_detail::isRgbx16Entry<Rgbx32Entry>(), "Rgbx32Entry layout");
+
+/* the element loop createRegammaLutBlobFromIDqe did before interleaveLut */
+template <typename ChannelT, size_t N, typename EntryT>
+void scalarInterleave(const std::array<ChannelT, N> &r, const std::array<ChannelT, N> &g,
+                      const std::array<ChannelT, N> &b, EntryT (&dst)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        dst[i].red = r[i];
+        dst[i].green = g[i];
+        dst[i].blue = b[i];
+        dst[i].reserved = 0;
+    }
+}
+
+/* the element loop createDegammaLutBlobFromIDqe did before expandLut */
+template <typename ChannelT, size_t N, typename EntryT>
+void scalarExpand(const std::array<ChannelT, N> &red, EntryT (&dst)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        dst[i].red = red[i];
+        dst[i].green = 0;
+        dst[i].blue = 0;
+        dst[i].reserved = 0;
+    }
+}
+
+template <typename ChannelT, size_t N>
+std::array<ChannelT, N> randomChannel(std::mt19937 &rng) {
+    std::uniform_int_distribution<uint32_t> dist;
+    std::array<ChannelT, N> channel;
+    for (auto &v : channel) v = static_cast<ChannelT>(dist(rng));
+    return channel;
+}
+
+/*
+ * Both destinations start from different garbage, so any entry or field the
+ * kernel leaves unwritten shows up as a mismatch.
+ */
+template <typename ChannelT, size_t N, typename EntryT>
+void expectSameBytes(std::mt19937 &rng) {
+    const auto r = randomChannel<ChannelT, N>(rng);
+    const auto g = randomChannel<ChannelT, N>(rng);
+    const auto b = randomChannel<ChannelT, N>(rng);
+
+    EntryT expected[N];
+    EntryT actual[N];
+
+    memset(expected, 0xa5, sizeof(expected));
+    memset(actual, 0x5a, sizeof(actual));
+    scalarInterleave(r, g, b, expected);
+    gs101::interleaveLut(r, g, b, actual);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(expected))) << "interleaveLut N=" << N;
+
+    memset(expected, 0xa5, sizeof(expected));
+    memset(actual, 0x5a, sizeof(actual));
+    scalarExpand(r, expected);
+    gs101::expandLut(r, actual);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(expected))) << "expandLut N=" << N;
+}
+
+/* lengths below, at and around the 8 entry vector width, so the tail loop runs too */
+template <typename ChannelT, typename EntryT>
+void expectSameBytesForLengths() {
+    std::mt19937 rng(0x050);
+    expectSameBytes<ChannelT, 1, EntryT>(rng);
+    expectSameBytes<ChannelT, 7, EntryT>(rng);
+    expectSameBytes<ChannelT, 8, EntryT>(rng);
+    expectSameBytes<ChannelT, 9, EntryT>(rng);
+    expectSameBytes<ChannelT, 16, EntryT>(rng);
+    expectSameBytes<ChannelT, 65, EntryT>(rng);
+}
+
+}  // namespace
+
+TEST(LutDataTest, Rgbx16MatchesScalarLoop) {
+    expectSameBytesForLengths<uint16_t, Rgbx16Entry>();
+}
+
+TEST(LutDataTest, Rgbx32MatchesScalarLoop) {
+    expectSameBytesForLengths<uint16_t, Rgbx32Entry>();
+    expectSameBytesForLengths<uint32_t, Rgbx32Entry>();
+}
+
+TEST(LutDataTest, DqeLutsMatchScalarLoop) {
+    using DegammaConfig = IDisplayColorGS101::IDqe::DegammaLutData::ConfigType;
+    using RegammaConfig = IDisplayColorGS101::IDqe::RegammaLutData::ConfigType;
+
+    std::mt19937 rng(0x101);
+    expectSameBytes<DegammaConfig::Container, DegammaConfig::kLutLen, Rgbx16Entry>(rng);
+    expectSameBytes<RegammaConfig::Container, RegammaConfig::kChannelLutLen, Rgbx16Entry>(rng);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <gs101/displaycolor/matrix_data.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+
+using namespace displaycolor;
+
+namespace {
+
+using DqeMatrixConfig = IDisplayColorGS101::IDqe::DqeMatrixData::ConfigType;
+using GmConfig = IDisplayColorGS101::IDpp::GmData::ConfigType;
+
+/* same shapes as exynos_matrix and hdr_gm_data in drm/samsung_drm.h */
+struct DqeMatrixBlob {
+    uint16_t coeffs[DqeMatrixConfig::kDimensions * DqeMatrixConfig::kDimensions];
+    uint16_t offsets[DqeMatrixConfig::kDimensions];
+};
+struct GmMatrixBlob {
+    uint32_t coeffs[GmConfig::kDimensions * GmConfig::kDimensions];
+    uint32_t offsets[GmConfig::kDimensions];
+};
+
+/* the element copy convertDqeMatrixDataToMatrix did before convertMatrixData */
+template <typename ConfigT, typename BlobT>
+void legacyCopy(const ConfigT &config, BlobT &blob) {
+    const uint32_t dimension = ConfigT::kDimensions;
+    for (uint32_t i = 0; i < (dimension * dimension); i++)
+        blob.coeffs[i] = config.matrix_data.coeffs[i];
+    for (uint32_t i = 0; i < dimension; i++)
+        blob.offsets[i] = config.matrix_data.offsets[i];
+}
+
+template <typename ConfigT, typename BlobT>
+void expectSameBytes(const ConfigT &config) {
+    BlobT expected;
+    BlobT actual;
+    memset(&expected, 0xa5, sizeof(expected));
+    memset(&actual, 0x5a, sizeof(actual));
+
+    legacyCopy(config, expected);
+    gs101::convertMatrixData(config, actual.coeffs, actual.offsets);
+    EXPECT_EQ(0, memcmp(&expected, &actual, sizeof(expected)));
+}
+
+template <typename ConfigT>
+void fill(ConfigT &config, std::initializer_list<int64_t> values) {
+    using Container = typename ConfigT::Container;
+    auto it = values.begin();
+    for (auto &coeff : config.matrix_data.coeffs) coeff = static_cast<Container>(*it++);
+    for (auto &offset : config.matrix_data.offsets) offset = static_cast<Container>(*it++);
+}
+
+}  // namespace
+
+TEST(MatrixDataTest, DqeMatrixMatchesLegacyCopy) {
+    DqeMatrixConfig config;
+    /* negative coefficients come as two's complement of the register width */
+    fill(config, {1024, -1, -1024, 0x7fff, -0x8000, 0x8000, 0xffff, 0, 1, -512, 0x3ff, -0x400});
+    expectSameBytes<DqeMatrixConfig, DqeMatrixBlob>(config);
+}
+
+TEST(MatrixDataTest, GmMatrixMatchesLegacyCopy) {
+    GmConfig config;
+    /* includes values outside the 19/17-bit register fields, they must pass through as is */
+    fill(config, {65536, -1, -65536, 0x3ffff, -0x40000, 0x40000, 0x7ffff, 0xfff80000, 0xffffffff,
+                  -0x10000, 0x1ffff, 0x80000000});
+    expectSameBytes<GmConfig, GmMatrixBlob>(config);
+}
+
+TEST(MatrixDataTest, RandomMatricesMatchLegacyCopy) {
+    std::mt19937 rng(0x101);
+    std::uniform_int_distribution<uint32_t> dist;
+
+    for (int i = 0; i < 1000; i++) {
+        DqeMatrixConfig dqe;
+        GmConfig gm;
+        for (auto &v : dqe.matrix_data.coeffs) v = static_cast<uint16_t>(dist(rng));
+        for (auto &v : dqe.matrix_data.offsets) v = static_cast<uint16_t>(dist(rng));
+        for (auto &v : gm.matrix_data.coeffs) v = dist(rng);
+        for (auto &v : gm.matrix_data.offsets) v = dist(rng);
+
+        expectSameBytes<DqeMatrixConfig, DqeMatrixBlob>(dqe);
+        expectSameBytes<GmConfig, GmMatrixBlob>(gm);
+    }
+}
+
+TEST(MatrixDataTest, StdArrayDestination) {
+    GmConfig config;
+    fill(config, {1, -2, 3, -4, 5, -6, 7, -8, 9, -10, 11, -12});
+
+    std::array<uint32_t, 9> coeffs;
+    std::array<uint32_t, 3> offsets;
+    gs101::convertMatrixData(config, coeffs, offsets);
+    EXPECT_EQ(config.matrix_data.coeffs, coeffs);
+    EXPECT_EQ(config.matrix_data.offsets, offsets);
+}
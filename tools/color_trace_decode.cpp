@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ColorTrace.h"
+
+/*
+ * Decode the color trace rings saved by ColorTrace::save(), e.g. with
+ * vendor.display.color.trace_save set during dumpsys, into the text of the
+ * dumpsys color trace. Records are listed per thread, or merged across threads
+ * in timestamp order with -m.
+ */
+
+using namespace android;
+using namespace gs101;
+
+namespace {
+
+struct Ring {
+    int32_t tid;
+    std::vector<ColorTrace::Record> records;
+};
+
+template <typename T>
+bool read(const uint8_t *&cursor, const uint8_t *end, T *out, size_t count = 1) {
+    const size_t size = sizeof(T) * count;
+    if (static_cast<size_t>(end - cursor) < size) return false;
+    memcpy(out, cursor, size);
+    cursor += size;
+    return true;
+}
+
+bool parse(const std::string &file, std::vector<Ring> &rings) {
+    const uint8_t *cursor = reinterpret_cast<const uint8_t *>(file.data());
+    const uint8_t *end = cursor + file.size();
+
+    ColorTrace::FileHeader header;
+    if (!read(cursor, end, &header) || (header.magic != ColorTrace::kFileMagic) ||
+        (header.version != ColorTrace::kFileVersion)) {
+        fprintf(stderr, "not a color trace\n");
+        return false;
+    }
+    if (header.recordSize != sizeof(ColorTrace::Record)) {
+        fprintf(stderr, "record size %u, this decoder reads %zu\n", header.recordSize,
+                sizeof(ColorTrace::Record));
+        return false;
+    }
+
+    rings.resize(header.ringCount);
+    for (auto &ring : rings) {
+        ColorTrace::RingHeader ringHeader;
+        if (!read(cursor, end, &ringHeader)) return false;
+        ring.tid = ringHeader.tid;
+        ring.records.resize(ringHeader.recordCount);
+        if (!read(cursor, end, ring.records.data(), ring.records.size())) return false;
+    }
+    return true;
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-d display] [-m] trace\n"
+            "  -d  only decode the records of this display\n"
+            "  -m  merge the threads in timestamp order\n",
+            name);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int display = -1;
+    bool merge = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:m")) != -1) {
+        switch (opt) {
+            case 'd':
+                display = atoi(optarg);
+                break;
+            case 'm':
+                merge = true;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string file;
+    std::vector<Ring> rings;
+    if (!android::base::ReadFileToString(argv[optind], &file)) {
+        fprintf(stderr, "failed to read %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (!parse(file, rings)) {
+        fprintf(stderr, "%s is truncated or corrupt\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    const auto selected = [display](const ColorTrace::Record &record) {
+        return (display < 0) || (record.display == display);
+    };
+
+    String8 result;
+    if (merge) {
+        std::vector<std::pair<int32_t, const ColorTrace::Record *>> records;
+        for (const auto &ring : rings) {
+            for (const auto &record : ring.records) {
+                if (selected(record)) records.emplace_back(ring.tid, &record);
+            }
+        }
+        std::stable_sort(records.begin(), records.end(), [](const auto &a, const auto &b) {
+            return a.second->timestamp < b.second->timestamp;
+        });
+        for (const auto &[tid, record] : records) {
+            result.appendFormat("tid %d ", tid);
+            ColorTrace::decode(*record, result);
+        }
+    } else {
+        for (const auto &ring : rings) {
+            bool first = true;
+            for (const auto &record : ring.records) {
+                if (!selected(record)) continue;
+                if (first) {
+                    result.appendFormat("color trace (tid %d):\n", ring.tid);
+                    first = false;
+                }
+                ColorTrace::decode(record, result);
+            }
+        }
+    }
+
+    fwrite(result.string(), 1, result.length(), stdout);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <gs101/displaycolor/displaycolor_gs101.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "DisplayColorLoader.h"
+#include "DisplaySceneTrace.h"
+
+/*
+ * Replay a DisplayScene trace captured with vendor.display.color.scene_capture
+ * into a displaycolor library, in capture order: Update() for SCENE_UPDATE
+ * records and UpdatePresent() for SCENE_PRESENT records. After each record the
+ * dirty stages are counted and acknowledged as HWC does once it has created
+ * their blobs. The call times are reported per record type.
+ */
+
+using namespace displaycolor;
+using namespace gs101;
+
+namespace {
+
+constexpr char kDefaultLib[] = "libdisplaycolor_stub.so";
+
+struct CallStats {
+    std::vector<int64_t> ns;
+    uint64_t failures = 0;
+    uint64_t dirtyDqeStages = 0;
+    uint64_t dirtyDppStages = 0;
+
+    void print(const char *name) {
+        if (ns.empty()) {
+            printf("%-14s      0 calls\n", name);
+            return;
+        }
+        std::sort(ns.begin(), ns.end());
+        int64_t total = 0;
+        for (int64_t t : ns) total += t;
+        const auto percentile = [this](size_t p) { return ns[(ns.size() - 1) * p / 100]; };
+        printf("%-14s %6zu calls  mean %7.1f us  p50 %7.1f us  p99 %7.1f us  max %7.1f us"
+               "  dirty dqe %" PRIu64 " dpp %" PRIu64 "  failed %" PRIu64 "\n",
+               name, ns.size(), total / 1000.0 / ns.size(), percentile(50) / 1000.0,
+               percentile(99) / 1000.0, ns.back() / 1000.0, dirtyDqeStages, dirtyDppStages,
+               failures);
+    }
+};
+
+template <typename StageT>
+uint64_t applyStage(const StageT &stage) {
+    if (!stage.enable || !stage.dirty) return 0;
+    stage.NotifyDataApplied();
+    return 1;
+}
+
+void applyPipeline(const IDisplayColorGS101::IDisplayPipelineData *pipeline, CallStats &stats) {
+    if (pipeline == nullptr) return;
+
+    const IDisplayColorGS101::IDqe &dqe = pipeline->Dqe();
+    stats.dirtyDqeStages += applyStage(dqe.DqeControl()) + applyStage(dqe.GammaMatrix()) +
+            applyStage(dqe.DegammaLut()) + applyStage(dqe.LinearMatrix()) +
+            applyStage(dqe.Cgc()) + applyStage(dqe.RegammaLut());
+
+    for (const IDisplayColorGS101::IDpp &dpp : pipeline->Dpp()) {
+        stats.dirtyDppStages += applyStage(dpp.EotfLut()) + applyStage(dpp.Gm()) +
+                applyStage(dpp.Dtm()) + applyStage(dpp.OetfLut());
+    }
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-l displaycolor_lib] [-n loops] trace\n"
+            "  -l  library to replay into (default %s)\n"
+            "  -n  replay the trace this many times (default 1)\n",
+            name, kDefaultLib);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *lib = kDefaultLib;
+    int loops = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:n:")) != -1) {
+        switch (opt) {
+            case 'l':
+                lib = optarg;
+                break;
+            case 'n':
+                loops = std::max(atoi(optarg), 1);
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::string trace;
+    if (!android::base::ReadFileToString(argv[optind], &trace)) {
+        fprintf(stderr, "failed to read %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(trace.data());
+    const uint8_t *end = begin + trace.size();
+    if (!DisplaySceneTrace::readFileHeader(begin, end)) {
+        fprintf(stderr, "%s is not a scene trace of this displaycolor interface\n",
+                argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    DisplayColorLoader loader(lib);
+    IDisplayColorGS101 *displayColor =
+            loader.GetDisplayColorGS101(std::vector<DisplayInfo>(DISPLAY_MAX));
+    if (displayColor == nullptr) {
+        fprintf(stderr, "failed to load displaycolor from %s\n", lib);
+        return EXIT_FAILURE;
+    }
+
+    CallStats update;
+    CallStats present;
+    size_t records = 0;
+    bool truncated = false;
+    for (int loop = 0; loop < loops; loop++) {
+        const uint8_t *cursor = begin;
+        DisplaySceneTrace::Record record;
+        while (cursor < end) {
+            if (!DisplaySceneTrace::deserialize(cursor, end, record)) {
+                truncated = true;
+                break;
+            }
+            records++;
+
+            const bool isUpdate = (record.type == DisplaySceneTrace::SCENE_UPDATE);
+            CallStats &stats = isUpdate ? update : present;
+            const auto start = std::chrono::steady_clock::now();
+            const int ret = isUpdate ? displayColor->Update(record.display, record.scene)
+                                     : displayColor->UpdatePresent(record.display, record.scene);
+            stats.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+            if (ret != 0) stats.failures++;
+            applyPipeline(displayColor->GetPipelineData(record.display), stats);
+        }
+    }
+
+    printf("%s: %zu records replayed into %s, %d loop(s)%s\n", argv[optind], records, lib,
+           loops, truncated ? ", trace truncated" : "");
+    update.print("Update");
+    present.print("UpdatePresent");
+    return EXIT_SUCCESS;
+}